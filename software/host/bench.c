@@ -0,0 +1,281 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+// Replays captured (or synthetic) terminal output through the terminal
+// emulation and reports throughput plus a checksum of the resulting
+// frame buffer contents (so refactorings can be checked for identical
+// screen output).
+//
+// usage: vtbench [-1] [-c chunksize] [-r repeat] [-t vt102|vt52|petscii] [-d] [-o] [file ...]
+//   -1   feed data byte-by-byte via terminal_receive_char()
+//   -c   chunk size passed to terminal_receive_buffer() (default 64)
+//   -r   number of times each input is replayed (default 10)
+//   -t   terminal type
+//   -d   print the screen contents after each replay
+//   -o   also time individual frame buffer operations
+// Without file arguments a set of synthetic workloads is used.
+// Captures can be made on a Linux host with e.g. "script -c 'ls -lR /usr' ls.txt".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "pico/stdlib.h"
+#include "config.h"
+#include "framebuf.h"
+#include "terminal.h"
+#include "host.h"
+
+struct Workload
+{
+  const char *name;
+  uint8_t    *data;
+  size_t      len;
+};
+
+
+static void append(uint8_t **buf, size_t *len, size_t *cap, const char *s, size_t n)
+{
+  if( *len+n > *cap )
+    {
+      *cap = (*len+n)*2;
+      *buf = realloc(*buf, *cap);
+    }
+
+  memcpy(*buf + *len, s, n);
+  *len += n;
+}
+
+
+static struct Workload make_text_workload()
+{
+  // plain log output: lines of varying length ending in CR+LF
+  struct Workload w = {"text", NULL, 0};
+  size_t cap = 0;
+  char line[100];
+  uint32_t seed = 1;
+
+  for(int i=0; i<4000; i++)
+    {
+      seed = seed*1103515245 + 12345;
+      int n = 10 + (seed>>16) % 70;
+      for(int j=0; j<n; j++) line[j] = 32 + (j*7+i) % 95;
+      line[n++] = '\r';
+      line[n++] = '\n';
+      append(&w.data, &w.len, &cap, line, n);
+    }
+
+  return w;
+}
+
+
+static struct Workload make_ansi_workload()
+{
+  // colored output with cursor positioning and erasing, similar to
+  // full-screen applications and colorized compiler output
+  struct Workload w = {"ansi", NULL, 0};
+  size_t cap = 0;
+  char line[200];
+
+  for(int i=0; i<4000; i++)
+    {
+      int n = snprintf(line, sizeof(line), "\033[%i;%iH\033[1;%im%s\033[0m: \033[4mline %i\033[24m of output\033[K\r\n",
+                       1 + i % 30, 1 + i % 20, 31 + i % 7, (i & 1) ? "warning" : "error", i);
+      append(&w.data, &w.len, &cap, line, n);
+    }
+
+  return w;
+}
+
+
+static struct Workload load_workload(const char *fname)
+{
+  struct Workload w = {fname, NULL, 0};
+  FILE *f = fopen(fname, "rb");
+  if( f==NULL ) { perror(fname); exit(1); }
+
+  fseek(f, 0, SEEK_END);
+  w.len  = ftell(f);
+  w.data = malloc(w.len ? w.len : 1);
+  fseek(f, 0, SEEK_SET);
+  if( fread(w.data, 1, w.len, f)!=w.len ) { perror(fname); exit(1); }
+  fclose(f);
+
+  return w;
+}
+
+
+static uint32_t screen_checksum()
+{
+  // FNV-1a over the frame buffer contents (characters, attributes, 
+  // colors as shown) in display row order and the row attributes
+  const uint8_t *rowattr = framebuf_mem_get_rowattr();
+  uint32_t h = 2166136261u;
+  for(size_t row=0; row<MAX_ROWS; row++)
+    for(size_t col=0; col<MAX_COLS; col++)
+      {
+        uint32_t cell = framebuf_mem_get_cell(col, row);
+        for(int i=0; i<4; i++) h = (h ^ ((cell >> (i*8)) & 0xFF)) * 16777619u;
+      }
+  for(size_t i=0; i<MAX_ROWS; i++) h = (h ^ rowattr[i]) * 16777619u;
+  return h;
+}
+
+
+static void dump_screen()
+{
+  for(int row=0; row<framebuf_get_nrows(); row++)
+    {
+      char line[MAX_COLS+1];
+      int n = framebuf_get_ncols(row);
+      for(int col=0; col<n; col++) 
+        {
+          uint8_t c = framebuf_get_char(col, row);
+          line[col] = (c>=32 && c<127) ? c : '.';
+        }
+      while( n>0 && line[n-1]==' ' ) n--;
+      line[n] = 0;
+      printf("|%s\n", line);
+    }
+}
+
+
+static void run_workload(const struct Workload *w, int repeat, size_t chunk, bool bytewise, bool dump)
+{
+  terminal_init();
+
+  absolute_time_t start = get_absolute_time();
+  for(int r=0; r<repeat; r++)
+    {
+      if( bytewise )
+        {
+          for(size_t i=0; i<w->len; i++)
+            terminal_receive_char(w->data[i]);
+        }
+      else
+        {
+          for(size_t i=0; i<w->len; i+=chunk)
+            terminal_receive_buffer(w->data+i, MIN(chunk, w->len-i));
+        }
+    }
+  absolute_time_t end = get_absolute_time();
+
+  double secs  = (end-start) / 1e6;
+  double bytes = (double) w->len * repeat;
+  printf("%-12s %10.0f bytes %8.3f s %8.2f MB/s  %8.0f ns/byte  checksum %08x\n", 
+         w->name, bytes, secs, bytes/secs/1e6, secs*1e9/bytes, screen_checksum());
+
+  if( dump ) dump_screen();
+}
+
+
+static void time_op(const char *name, void (*fn)(int i), int n)
+{
+  absolute_time_t start = get_absolute_time();
+  for(int i=0; i<n; i++) fn(i);
+  absolute_time_t end = get_absolute_time();
+  printf("%-28s %10.0f ns/op\n", name, (end-start)*1e3/n);
+}
+
+
+static const uint8_t span_chars[80] = "The quick brown fox jumps over the lazy dog. 0123456789 ABCDEFGHIJKLMNOPQRSTUVW";
+
+static void op_set_char(int i)      { framebuf_set_char(i%80, i%30, 'A'+i%26); }
+static void op_set_attr(int i)      { framebuf_set_attr(i%80, i%30, i&15); }
+static void op_set_color(int i)     { framebuf_set_color(i%80, i%30, i&15, (i>>4)&7); }
+static void op_set_span(int i)      { framebuf_set_span(0, i%30, span_chars, 80, 0, 7, 0); }
+static void op_fill_screen(int i)   { framebuf_fill_screen(' ', 7, 0); }
+static void op_fill_line(int i)     { framebuf_fill_region(0, i%30, 79, i%30, ' ', 7, 0); }
+static void op_scroll_screen(int i) { framebuf_scroll_screen(1, 7, 0); }
+static void op_scroll_region(int i) { framebuf_scroll_region(5, 20, (i&1) ? 1 : -1, 7, 0); }
+static void op_scroll_rect(int i)   { framebuf_scroll_rect(10, 5, 69, 20, (i&1) ? 1 : -1, 7, 0); }
+static void op_insert(int i)        { framebuf_insert(10, 79, i%30, 1, 7, 0); }
+static void op_delete(int i)        { framebuf_delete(10, 79, i%30, 1, 7, 0); }
+static void op_take_dirty(int i)    { framebuf_set_char(0, i%30, 'x'); framebuf_take_dirty_rows(FRAMEBUF_DIRTY_VIDEO); }
+
+static void time_ops()
+{
+  terminal_init();
+  time_op("framebuf_set_char", op_set_char, 1000000);
+  time_op("framebuf_set_attr", op_set_attr, 1000000);
+  time_op("framebuf_set_color", op_set_color, 1000000);
+  time_op("framebuf_set_span (80)", op_set_span, 100000);
+  time_op("framebuf_fill_region (row)", op_fill_line, 100000);
+  time_op("framebuf_fill_screen", op_fill_screen, 10000);
+  time_op("framebuf_scroll_screen (1)", op_scroll_screen, 100000);
+  time_op("framebuf_scroll_region (1)", op_scroll_region, 100000);
+  time_op("framebuf_scroll_rect (1)", op_scroll_rect, 100000);
+  time_op("framebuf_insert (1)", op_insert, 100000);
+  time_op("framebuf_delete (1)", op_delete, 100000);
+  time_op("set_char + take_dirty_rows", op_take_dirty, 100000);
+  terminal_init();
+}
+
+
+int main(int argc, char **argv)
+{
+  int repeat = 10, opt;
+  size_t chunk = 64;
+  bool bytewise = false, dump = false, ops = false;
+
+  while( (opt=getopt(argc, argv, "1c:r:t:do"))!=-1 )
+    switch( opt )
+      {
+      case '1': bytewise = true; break;
+      case 'd': dump = true; break;
+      case 'o': ops  = true; break;
+      case 'c': chunk  = MAX(1, atoi(optarg)); break;
+      case 'r': repeat = MAX(1, atoi(optarg)); break;
+      case 't': 
+        if( strcmp(optarg, "vt52")==0 ) 
+          host_config.ttype = CFG_TTYPE_VT52;
+        else if( strcmp(optarg, "petscii")==0 )
+          host_config.ttype = CFG_TTYPE_PETSCII;
+        else
+          host_config.ttype = CFG_TTYPE_VT102;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-1] [-c chunksize] [-r repeat] [-t vt102|vt52|petscii] [-d] [-o] [file ...]\n", argv[0]);
+        return 1;
+      }
+
+  framebuf_init(false);
+  terminal_init();
+  if( ops ) time_ops();
+
+  if( optind<argc )
+    {
+      for(int i=optind; i<argc; i++)
+        {
+          struct Workload w = load_workload(argv[i]);
+          run_workload(&w, repeat, chunk, bytewise, dump);
+          free(w.data);
+        }
+    }
+  else
+    {
+      struct Workload w[2] = {make_text_workload(), make_ansi_workload()};
+      for(int i=0; i<2; i++)
+        {
+          run_workload(&w[i], repeat, chunk, bytewise, dump);
+          free(w[i].data);
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+// Memory-only frame buffer backend for the host build. Uses the same
+// character layout as the VGA backend (char, attr, bg, fg per cell)
+// but does not produce any video output. The DVI entry points map to
+// the same storage so framebuf.c links unchanged. Bold and inverse
+// attributes and the cursor are applied when reading back cells as they
+// would be shown.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "framebuf.h"
+#include "framebuf_dvi.h"
+#include "framebuf_vga.h"
+#include "host.h"
+
+static uint8_t *charbuf = NULL;   // page modified by the frame buffer operations
+static uint8_t *showbuf = NULL;   // page shown on screen
+static uint8_t *showrowattr = NULL;
+static bool     inverted = false;
+
+extern uint8_t framebuf_bold_color[256];
+extern volatile uint32_t framebuf_cursor;
+
+
+const uint8_t *framebuf_mem_get_data()
+{
+  return showbuf;
+}
+
+
+uint32_t framebuf_mem_get_cell(uint32_t col, uint32_t row)
+{
+  // character, attribute, background and foreground color at the given
+  // position within the frame as the video renderers would show them
+  uint32_t cursor = framebuf_cursor;
+  uint32_t idx = showrowattr[FRAMEBUF_ROWMAP_OFFSET+row]*MAX_COLS + col;
+  uint8_t c = showbuf[idx*4], a = showbuf[idx*4+1], bg = showbuf[idx*4+2], fg = showbuf[idx*4+3];
+  if( col==(cursor & 0xFF) && row>=((cursor >> 8) & 0xFF) && row<((cursor >> 8) & 0xFF)+((cursor >> 16) & 0xFF) )
+    a ^= cursor >> 24;
+  if( a & ATTR_BOLD ) fg = framebuf_bold_color[fg];
+  if( ((a & ATTR_INVERSE)!=0) != inverted ) { uint8_t t = fg; fg = bg; bg = t; }
+  return c | (a << 8) | (bg << 16) | ((uint32_t) fg << 24);
+}
+
+
+const uint8_t *framebuf_mem_get_rowattr()
+{
+  return showrowattr;
+}
+
+
+void framebuf_vga_init(uint8_t *databuf, uint8_t *ra)
+{
+  charbuf = showbuf = databuf;
+  showrowattr = ra;
+}
+
+
+void framebuf_vga_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint32_t w = c + (a<<8) + (bg << 16) + ((uint32_t) fg << 24);
+  uint32_t *buf = (uint32_t *) (charbuf + idx*4);
+  for(size_t i=0; i<n; i++) buf[i] = w;
+}
+
+
+void framebuf_vga_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+{
+  memmove(charbuf+toidx*4, charbuf+fromidx*4, n*4);
+}
+
+
+void framebuf_vga_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint32_t w = (a<<8) + (bg << 16) + ((uint32_t) fg << 24);
+  uint32_t *buf = (uint32_t *) (charbuf + idx*4);
+  for(size_t i=0; i<n; i++) buf[i] = w | chars[i];
+}
+
+
+void framebuf_vga_charmemget(uint32_t idx, uint32_t *buf, size_t n)
+{
+  memcpy(buf, charbuf+idx*4, n*4);
+}
+
+
+void    framebuf_vga_set_char(uint32_t idx, uint8_t c) { charbuf[idx*4] = c; }
+uint8_t framebuf_vga_get_char(uint32_t idx) { return charbuf[idx*4]; }
+void    framebuf_vga_set_attr(uint32_t idx, uint8_t a) { charbuf[idx*4+1] = a; }
+uint8_t framebuf_vga_get_attr(uint32_t idx) { return charbuf[idx*4 + 1]; }
+
+
+void framebuf_vga_invert()
+{
+  inverted = !inverted;
+}
+
+
+void framebuf_vga_set_color(uint32_t idx, uint8_t fg, uint8_t bg)
+{
+  charbuf[idx*4 + 2] = bg;
+  charbuf[idx*4 + 3] = fg;
+}
+
+
+void framebuf_vga_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg)
+{
+  *bg = charbuf[idx*4 + 2];
+  *fg = charbuf[idx*4 + 3];
+}
+
+
+void     framebuf_vga_set_char_and_attr(uint32_t idx, uint32_t c) { ((uint32_t *) charbuf)[idx] = c; }
+uint32_t framebuf_vga_get_char_and_attr(uint32_t idx) { return ((uint32_t *) charbuf)[idx]; }
+
+
+void framebuf_vga_set_page(uint8_t *databuf, uint8_t *ra)
+{
+  charbuf = databuf;
+}
+
+
+void framebuf_vga_show_page(uint8_t *databuf, uint8_t *ra)
+{
+  showbuf = databuf;
+  showrowattr = ra;
+}
+
+
+void framebuf_dvi_init(uint8_t *databuf, uint8_t *ra) { framebuf_vga_init(databuf, ra); }
+void framebuf_dvi_set_page(uint8_t *databuf, uint8_t *ra) { framebuf_vga_set_page(databuf, ra); }
+void framebuf_dvi_show_page(uint8_t *databuf, uint8_t *ra) { framebuf_vga_show_page(databuf, ra); }
+void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n) { framebuf_vga_charmemset(idx, c, a, fg, bg, n); }
+void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n) { framebuf_vga_charmemmove(toidx, fromidx, n); }
+void framebuf_dvi_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n) { framebuf_vga_charmemcpy(idx, chars, a, fg, bg, n); }
+void framebuf_dvi_charmemget(uint32_t idx, uint32_t *buf, size_t n) { framebuf_vga_charmemget(idx, buf, n); }
+uint8_t framebuf_dvi_get_char(uint32_t idx) { return framebuf_vga_get_char(idx); }
+void    framebuf_dvi_set_char(uint32_t idx, uint8_t c) { framebuf_vga_set_char(idx, c); }
+uint8_t framebuf_dvi_get_attr(uint32_t idx) { return framebuf_vga_get_attr(idx); }
+void    framebuf_dvi_set_attr(uint32_t idx, uint8_t a) { framebuf_vga_set_attr(idx, a); }
+void framebuf_dvi_set_color(uint32_t idx, uint8_t fg, uint8_t bg) { framebuf_vga_set_color(idx, fg, bg); }
+void framebuf_dvi_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg) { framebuf_vga_get_color(idx, fg, bg); }
+void framebuf_dvi_invert() { framebuf_vga_invert(); }
+void     framebuf_dvi_set_char_and_attr(uint32_t idx, uint32_t c) { framebuf_vga_set_char_and_attr(idx, c); }
+uint32_t framebuf_dvi_get_char_and_attr(uint32_t idx) { return framebuf_vga_get_char_and_attr(idx); }
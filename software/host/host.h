@@ -0,0 +1,38 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+#ifndef HOST_H
+#define HOST_H
+
+#include "pico/stdlib.h"
+
+struct HostConfigStruct
+{
+  uint8_t ttype, rows, cols, font, cr, lf, display;
+};
+
+extern struct HostConfigStruct host_config;
+
+size_t host_get_output_len();
+void   host_push_key(uint16_t key);
+
+const uint8_t *framebuf_mem_get_data();
+const uint8_t *framebuf_mem_get_rowattr();
+uint32_t       framebuf_mem_get_cell(uint32_t col, uint32_t row);
+
+#endif
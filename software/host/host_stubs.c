@@ -0,0 +1,170 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+// Host replacements for the modules that talk to hardware (configuration
+// storage, keyboard, sound, serial, flash). Settings are fixed to the
+// defaults of the firmware configuration menu.
+
+#include <stdio.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "font.h"
+#include "config.h"
+#include "keyboard.h"
+#include "serial.h"
+#include "sound.h"
+#include "flash.h"
+#include "xmodem.h"
+#include "host.h"
+
+static const uint8_t default_colors_ansi_vga[16] =
+  {0b00000000, 0b10000000, 0b00010000, 0b10010000, 0b00000010, 0b10000010, 0b00010010, 0b10010010, 
+   0b01001001, 0b11100000, 0b00011100, 0b11111100, 0b00000011, 0b11100011, 0b00011111, 0b11111111};
+
+static const uint8_t default_colors_ansi_dvi[16] =
+  {0b000000, 0b100000, 0b001000, 0b101000, 0b000010, 0b100010, 0b001010, 0b101010, 
+   0b010101, 0b110000, 0b001100, 0b111100, 0b000011, 0b110011, 0b001111, 0b111111};
+
+struct HostConfigStruct host_config = 
+  {
+    .ttype  = CFG_TTYPE_VT102,
+    .rows   = 30,
+    .cols   = 80,
+    .font   = FONT_ID_TERM,
+    .cr     = 1,
+    .lf     = 2,
+    .display = CFG_DISPTYPE_VGA
+  };
+
+static size_t host_output_len = 0;
+
+
+absolute_time_t get_absolute_time()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000ull + ts.tv_nsec / 1000;
+}
+
+uint32_t time_us_32()
+{
+  return (uint32_t) get_absolute_time();
+}
+
+void wait(uint32_t milliseconds) {}
+
+size_t host_get_output_len() { return host_output_len; }
+
+uint32_t config_get_serial_baud()     { return 115200; }
+uint8_t  config_get_serial_bits()     { return 8; }
+char     config_get_serial_parity()   { return 'N'; }
+uint8_t  config_get_serial_stopbits() { return 1; }
+uint8_t  config_get_serial_ctsmode()  { return 0; }
+uint8_t  config_get_serial_rtsmode()  { return 0; }
+uint8_t  config_get_serial_xonxoff()  { return 0; }
+uint16_t config_get_serial_blink()    { return 0; }
+
+uint8_t config_get_screen_rows()        { return host_config.rows; }
+uint8_t config_get_screen_cols()        { return host_config.cols; }
+bool    config_get_screen_dblchars()    { return false; }
+uint8_t config_get_screen_font_normal() { return host_config.font; }
+uint8_t config_get_screen_font_bold()   { return 0; }
+uint8_t config_get_screen_blink_period(){ return 60; }
+uint8_t config_get_screen_display()     { return host_config.display; }
+bool    config_get_screen_monochrome()  { return false; }
+uint8_t config_get_screen_monochrome_backgroundcolor(bool dvi) { return 0; }
+uint8_t config_get_screen_monochrome_textcolor_normal(bool dvi) { return dvi ? 0b101010 : 0b10010010; }
+uint8_t config_get_screen_monochrome_textcolor_bold(bool dvi) { return dvi ? 0b111111 : 0b11111111; }
+uint8_t config_get_screen_color(uint8_t color, bool dvi) { return dvi ? default_colors_ansi_dvi[color&15] : default_colors_ansi_vga[color&15]; }
+
+uint8_t config_get_terminal_type()        { return host_config.ttype; }
+uint8_t config_get_terminal_localecho()   { return 0; }
+uint8_t config_get_terminal_cursortype()  { return 0; }
+uint8_t config_get_terminal_cr()          { return host_config.cr; }
+uint8_t config_get_terminal_lf()          { return host_config.lf; }
+uint8_t config_get_terminal_bs()          { return 1; }
+uint8_t config_get_terminal_del()         { return 2; }
+bool    config_get_terminal_clearBit7()   { return false; }
+bool    config_get_terminal_uppercase()   { return false; }
+uint16_t config_get_terminal_scrolldelay(){ return 0; }
+uint8_t config_get_terminal_default_fg()  { return 7; }
+uint8_t config_get_terminal_default_bg()  { return 0; }
+uint8_t config_get_terminal_default_attr(){ return 0; }
+const char *config_get_terminal_answerback() { return ""; }
+
+uint8_t config_get_keyboard_enter()       { return 0; }
+uint8_t config_get_keyboard_backspace()   { return 0; }
+uint8_t config_get_keyboard_delete()      { return 1; }
+uint8_t config_get_keyboard_scroll_lock() { return 0; }
+
+uint16_t config_get_audible_bell_frequency() { return 0; }
+uint16_t config_get_audible_bell_volume()    { return 0; }
+uint16_t config_get_audible_bell_duration()  { return 0; }
+uint16_t config_get_visual_bell_color()      { return 0; }
+uint8_t  config_get_visual_bell_duration()   { return 0; }
+
+uint8_t config_get_usb_cdcmode() { return 0; }
+bool    config_menu_active()     { return false; }
+
+// keyboard input is a simple queue filled by host_push_key()
+static uint16_t keys[16];
+static size_t   num_keys = 0;
+
+void host_push_key(uint16_t key)
+{
+  if( num_keys<16 ) keys[num_keys++] = key;
+}
+
+size_t keyboard_num_keypress() 
+{
+  return num_keys;
+}
+
+uint16_t keyboard_read_keypress()
+{
+  uint16_t key = HID_KEY_NONE;
+  if( num_keys>0 )
+    {
+      key = keys[0];
+      memmove(keys, keys+1, --num_keys * sizeof(uint16_t));
+    }
+  return key;
+}
+
+uint8_t keyboard_get_led_status() { return 0; }
+bool    keyboard_ctrl_pressed(uint16_t key)  { return false; }
+bool    keyboard_alt_pressed(uint16_t key)   { return false; }
+bool    keyboard_shift_pressed(uint16_t key) { return false; }
+uint8_t keyboard_map_key_ascii(uint16_t key, bool *isaltcode) { *isaltcode = false; return key & 0xFF; }
+
+void sound_play_tone(uint16_t frequency, uint16_t duration_ms, uint8_t volume, bool wait) {}
+
+void serial_set_break(bool set) {}
+void serial_send_char(char c) { host_output_len++; }
+void serial_send_string(const char *s) { host_output_len += strlen(s); }
+void serial_cdc_send_char(char c) { host_output_len++; }
+void serial_cdc_send_string(const char *s) { host_output_len += strlen(s); }
+int  serial_xmodem_receive_char(int msDelay) { return -1; }
+void serial_xmodem_send_data(const char *data, int size) {}
+
+bool xmodem_receive(int (*recvChar)(int), void (*sendData)(const char *data, int len), bool (*dataHandler)(unsigned long, char*, int)) { return false; }
+
+uint32_t flash_get_write_offset(uint8_t sector) { return 0; }
+uint8_t *flash_get_read_ptr(uint8_t sector) { return NULL; }
+int  flash_write(uint8_t sector, const void *data, size_t length) { return 0; }
+void flash_read(uint8_t sector, void *data, size_t length) { memset(data, 0xFF, length); }
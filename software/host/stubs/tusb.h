@@ -0,0 +1,43 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Only the HID constants used by the terminal emulation
+
+#ifndef HOST_TUSB_H
+#define HOST_TUSB_H
+
+#include "pico/stdlib.h"
+
+#define HID_KEY_NONE       0x00
+#define HID_KEY_Z          0x1D
+#define HID_KEY_ESCAPE     0x29
+#define HID_KEY_F10        0x43
+#define HID_KEY_PAUSE      0x48
+#define HID_KEY_HOME       0x4A
+#define HID_KEY_PAGE_UP    0x4B
+#define HID_KEY_END        0x4D
+#define HID_KEY_PAGE_DOWN  0x4E
+#define HID_KEY_ARROW_DOWN 0x51
+#define HID_KEY_ARROW_UP   0x52
+
+#define KEYBOARD_LED_NUMLOCK    (1 << 0)
+#define KEYBOARD_LED_CAPSLOCK   (1 << 1)
+#define KEYBOARD_LED_SCROLLLOCK (1 << 2)
+
+#endif
@@ -0,0 +1,115 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+// Checks that the terminal emulation produces the same screen whether its
+// input arrives in buffers (terminal_receive_buffer(), which prints runs of
+// text and jump-scrolls over pending line feeds) or byte-by-byte.
+//
+// usage: test_chunked
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "framebuf.h"
+#include "terminal.h"
+#include "host.h"
+
+static int failures = 0;
+
+// fills the screen so the cursor ends up on the bottom row
+#define FILL \
+  "line 1\r\nline 2\r\nline 3\r\nline 4\r\nline 5\r\nline 6\r\nline 7\r\nline 8\r\nline 9\r\nline 10\r\n" \
+  "line 11\r\nline 12\r\nline 13\r\nline 14\r\nline 15\r\nline 16\r\nline 17\r\nline 18\r\nline 19\r\nline 20\r\n" \
+  "line 21\r\nline 22\r\nline 23\r\nline 24\r\nline 25\r\nline 26\r\nline 27\r\nline 28\r\nline 29\r\nline 30"
+
+static const char *cases[] =
+  {
+    // line feeds within an unfinished escape sequence
+    FILL "\033[\n5Hxx\n\n\nyy",
+    FILL "\033[2;\n\n\n9Hxx\n\n\nyy",
+
+    // left/right margins
+    FILL "\033[?69h\033[10;20s\033[30;1HA\nX\nY\nB",
+    "\033[?7l\033[?69h\033[8;76s\033[23;75Hhello world",
+    "\033[2;27r\033[?69h\033[18;58s\033[27;20Hb1bdf\n\n\n\t\n",
+
+    // plain scrolling text
+    FILL "\r\n\r\n\r\nabc\r\n\n\n\ndef\tghi\r\n",
+  };
+
+
+static uint32_t screen_checksum()
+{
+  // FNV-1a over the frame buffer contents and row attributes (same as vtbench)
+  const uint8_t *rowattr = framebuf_mem_get_rowattr();
+  uint32_t h = 2166136261u;
+  for(size_t row=0; row<MAX_ROWS; row++)
+    for(size_t col=0; col<MAX_COLS; col++)
+      {
+        uint32_t cell = framebuf_mem_get_cell(col, row);
+        for(int i=0; i<4; i++) h = (h ^ ((cell >> (i*8)) & 0xFF)) * 16777619u;
+      }
+  for(size_t i=0; i<MAX_ROWS; i++) h = (h ^ rowattr[i]) * 16777619u;
+  return h;
+}
+
+
+static uint32_t run(const char *data, size_t chunk)
+{
+  // feed data in chunks of the given size (0: byte-by-byte)
+  size_t len = strlen(data);
+  terminal_init();
+
+  if( chunk==0 )
+    for(size_t i=0; i<len; i++)
+      terminal_receive_char(data[i]);
+  else
+    for(size_t i=0; i<len; i+=chunk)
+      terminal_receive_buffer((const uint8_t *) data+i, MIN(chunk, len-i));
+
+  return screen_checksum();
+}
+
+
+int main()
+{
+  static const size_t chunks[] = {1, 3, 64, 4096};
+
+  framebuf_init(false);
+  for(size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++)
+    {
+      uint32_t expected = run(cases[i], 0);
+      for(size_t j=0; j<sizeof(chunks)/sizeof(chunks[0]); j++)
+        {
+          uint32_t h = run(cases[i], chunks[j]);
+          if( h!=expected )
+            {
+              printf("case %u, chunk size %u: checksum %08x, byte-by-byte %08x\n",
+                     (unsigned) i, (unsigned) chunks[j], h, expected);
+              failures++;
+            }
+        }
+    }
+
+  if( failures>0 )
+    printf("%i check(s) failed\n", failures);
+  else
+    printf("all checks passed\n");
+
+  return failures>0 ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+// Tests for the UART receive ring buffer consumer (serial_ring.c). The RX
+// DMA channel is replaced by produce(), which writes bytes round-robin into
+// the buffer and counts them the same way the DMA transfer counter does.
+//
+// usage: test_serial_ring
+
+#include <stdio.h>
+#include <string.h>
+#include "serial_ring.h"
+
+#define SIZE 16
+
+static uint8_t  buf[SIZE];
+static uint32_t head;
+static uint8_t  next;
+static int      failures = 0;
+
+#define CHECK(cond) \
+  do { if( !(cond) ) { printf("%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while( 0 )
+
+
+static void produce(size_t n)
+{
+  // write n bytes (0, 1, 2, ...) the way the DMA channel would
+  while( n-- ) buf[head++ & (SIZE-1)] = next++;
+}
+
+
+static void reset(uint32_t start, struct serial_ring *r)
+{
+  memset(buf, 0, sizeof(buf));
+  head = start;
+  next = 0;
+  serial_ring_init(r, buf, SIZE, head);
+}
+
+
+static void test_read()
+{
+  struct serial_ring r;
+  uint8_t data[SIZE];
+
+  reset(0, &r);
+  CHECK(serial_ring_level(&r, head)==0);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==0);
+
+  produce(5);
+  CHECK(serial_ring_level(&r, head)==5);
+  CHECK(serial_ring_peek(&r, r.tail+2)==2);
+  CHECK(serial_ring_read(&r, head, data, 3)==3);
+  CHECK(data[0]==0 && data[1]==1 && data[2]==2);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==2);
+  CHECK(data[0]==3 && data[1]==4);
+  CHECK(serial_ring_level(&r, head)==0);
+  CHECK(r.overflows==0 && r.lost==0);
+}
+
+
+static void test_wrap()
+{
+  struct serial_ring r;
+  uint8_t data[SIZE];
+
+  // data wrapping around the end of the buffer
+  reset(0, &r);
+  produce(10);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==10);
+  produce(12);
+  CHECK(serial_ring_level(&r, head)==12);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==12);
+  for(int i=0; i<12; i++) CHECK(data[i]==10+i);
+
+  // a completely full buffer is not an overrun
+  produce(SIZE);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==SIZE);
+  for(int i=0; i<SIZE; i++) CHECK(data[i]==22+i);
+  CHECK(r.overflows==0 && r.lost==0);
+
+  // byte counter wrapping at 2^32
+  reset(0xFFFFFFF8, &r);
+  produce(12);
+  CHECK(head==4);
+  CHECK(serial_ring_level(&r, head)==12);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==12);
+  for(int i=0; i<12; i++) CHECK(data[i]==i);
+  CHECK(r.tail==4 && r.overflows==0);
+}
+
+
+static void test_overflow()
+{
+  struct serial_ring r;
+  uint8_t data[SIZE];
+
+  // producer gets more than a buffer size ahead: only the newest
+  // half of the buffer is kept, the rest is counted as lost
+  reset(0, &r);
+  produce(3);
+  CHECK(serial_ring_read(&r, head, data, 1)==1);
+  produce(SIZE+4);
+  CHECK(serial_ring_level(&r, head)==SIZE/2);
+  CHECK(r.overflows==1);
+  CHECK(r.lost==SIZE+6-SIZE/2);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==SIZE/2);
+  for(int i=0; i<SIZE/2; i++) CHECK(data[i]==SIZE+7-SIZE/2+i);
+
+  // continues normally afterwards
+  produce(2);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==2);
+  CHECK(data[0]==SIZE+7 && data[1]==SIZE+8);
+  CHECK(r.overflows==1);
+
+  // overrun across the 2^32 boundary of the byte counter
+  reset(0xFFFFFFFC, &r);
+  produce(3*SIZE);
+  CHECK(serial_ring_read(&r, head, data, sizeof(data))==SIZE/2);
+  CHECK(data[0]==3*SIZE-SIZE/2);
+  CHECK(r.overflows==1 && r.lost==3*SIZE-SIZE/2);
+}
+
+
+int main()
+{
+  test_read();
+  test_wrap();
+  test_overflow();
+
+  if( failures>0 )
+    printf("%i check(s) failed\n", failures);
+  else
+    printf("all checks passed\n");
+
+  return failures>0 ? 1 : 0;
+}
@@ -27,6 +27,8 @@
 #include "pins.h"
 #include "sound.h"
 #include "xmodem.h"
+#include "serial_cdc.h"
+#include "profile.h"
 #include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
@@ -358,6 +360,9 @@ static int user_font_name_fn(const struct MenuItemStruct *item, int callType, in
 static int bell_test_fn(const struct MenuItemStruct *item, int callType, int row, int col);
 static int displaytype_fn(const struct MenuItemStruct *item, int callType, int row, int col);
 static int usbtype_fn(const struct MenuItemStruct *item, int callType, int row, int col);
+#ifdef VERSATERM_PROFILE
+static int profile_fn(const struct MenuItemStruct *item, int callType, int row, int col);
+#endif
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") serialMenu[] =
@@ -486,7 +491,7 @@ static const struct MenuItemStruct __in_flash(".configmenus") fontMenu[] =
 
 static const struct MenuItemStruct __in_flash(".configmenus") usbMenu[] =
     {{'1', "USB port mode",  0, NULL, 0, usbtype_fn, &settings.USB.mode,   0, 3, 1, 3, {"Disabled", "Device", "Host", "Auto-detect"}},
-     {'2', "USB CDC device mode", 0, NULL, 0, NULL, &settings.USB.cdcmode, 0, 3, 1, 2, {"Disabled", "Serial", "Pass-through", "Pass-through (terminal disabled)"}}};
+     {'2', "USB CDC device mode", 0, NULL, 0, NULL, &settings.USB.cdcmode, 0, 4, 1, 2, {"Disabled", "Serial", "Pass-through", "Pass-through (terminal disabled)", "Separate console"}}};
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") mainMenu[] =
@@ -497,7 +502,11 @@ static const struct MenuItemStruct __in_flash(".configmenus") mainMenu[] =
      {'5', "Font settings",      0, fontMenu, NUM_MENU_ITEMS(fontMenu)},
      {'6', "Bell settings",      0, bellMenu, NUM_MENU_ITEMS(bellMenu)},
      {'7', "USB settings" ,      0, usbMenu, NUM_MENU_ITEMS(usbMenu)},
-     {'8', "Manage configurations", 0, NULL, 0, configs_fn}};
+     {'8', "Manage configurations", 0, NULL, 0, configs_fn},
+#ifdef VERSATERM_PROFILE
+     {'9', "Profiling results",  0, NULL, 0, profile_fn},
+#endif
+    };
 
 
 // -----------------------------------------------------------------------------------------------------------------
@@ -2022,6 +2031,74 @@ static int INFLASHFUN bell_test_fn(const struct MenuItemStruct *item, int callTy
 }
 
 
+#ifdef VERSATERM_PROFILE
+static int profile_row;
+
+static void INFLASHFUN profile_print_line(const char *line)
+{
+  print("\033[%i;1H%s", profile_row++, line);
+}
+
+
+static void INFLASHFUN profile_send(const char *s)
+{
+  // the CDC FIFO only holds 64 bytes: keep USB running until everything is
+  // sent, give up if the host disconnects or does not read for 250ms
+  size_t n = strlen(s);
+  absolute_time_t timeout = make_timeout_time_ms(250);
+  while( n>0 && serial_cdc_is_connected() && !time_reached(timeout) )
+    {
+      size_t written = serial_cdc_send_buffer(s, n);
+      s += written;
+      n -= written;
+      if( written>0 ) timeout = make_timeout_time_ms(250);
+      if( n>0 ) tud_task();
+    }
+}
+
+
+static void INFLASHFUN profile_send_line(const char *line)
+{
+  profile_send(line);
+  profile_send("\r\n");
+}
+
+
+static int INFLASHFUN profile_fn(const struct MenuItemStruct *item, int callType, int row, int col)
+{
+  int res = 0;
+
+  if( callType==IFT_QUERY )
+    res = IFT_EDIT;
+  else if( callType==IFT_EDIT )
+    {
+      while( 1 )
+        {
+          print("\033[2J");
+          profile_row = 2;
+          profile_report(profile_print_line);
+          print("\033[%i;1H[D]ump via USB serial, [R]eset counters, any other key to exit...", profile_row+1);
+
+          uint8_t c = waitkey(false);
+          if( c=='d' || c=='D' )
+            {
+              profile_report(profile_send_line);
+              serial_cdc_flush();
+            }
+          else if( c=='r' || c=='R' )
+            profile_reset();
+          else
+            break;
+        }
+
+      res = 1;
+    }
+  
+  return res;
+}
+#endif
+
+
 static int INFLASHFUN displaytype_fn(const struct MenuItemStruct *item, int callType, int row, int col)
 {
   int res = 0;
@@ -30,23 +30,85 @@
 #include "framebuf.h"
 #include "framebuf_dvi.h"
 #include "framebuf_vga.h"
+#include "scrollback.h"
+#include "stats.h"
+#include "profile.h"
 
 // defined in main.c
 void wait(uint32_t milliseconds);
 
-static __attribute__((aligned(4))) uint8_t framebuf_data[80*60*4];  // shared data buffer
-static __attribute__((aligned(4))) uint8_t framebuf_rowattr[60];    // row attributes
+// screen pages (normal and alternate screen of each console), each with its
+// own data buffer (shared with the video backend) and row attributes + row
+// map. The pointers below refer to the page that operations work on, which
+// is not necessarily the one shown on screen.
+static __attribute__((aligned(4))) uint8_t framebuf_pages[FRAMEBUF_NUM_PAGES][80*60*4];
+static __attribute__((aligned(4))) uint8_t framebuf_page_rowattr[FRAMEBUF_NUM_PAGES][FRAMEBUF_ROWMAP_OFFSET*2];
+static uint8_t *framebuf_data    = framebuf_pages[0];
+static uint8_t *framebuf_rowattr = framebuf_page_rowattr[0];
+static uint8_t *framebuf_rowmap  = framebuf_page_rowattr[0]+FRAMEBUF_ROWMAP_OFFSET;
+static uint8_t  current_page = 0, shown_page = 0;
 int16_t framebuf_flash_counter = 0;
 uint8_t framebuf_flash_color = 0;
 
+// color shown for the foreground color of bold characters (identity unless
+// bold is shown as a brighter color), applied by the video backends, and the
+// reverse mapping for the colors that differ (used by the VGA backend)
+uint8_t framebuf_bold_color[256], framebuf_bold_color_inv[256];
 
-static bool screen_inverted = false, double_size_chars = false;
+// cursor drawn by the video renderers: column (bits 0-7) and row (bits 8-15)
+// within the frame, number of rows (bits 16-23) and the attributes toggled
+// at its position (bits 24-31, 0 if the cursor is hidden)
+volatile uint32_t framebuf_cursor = 0;
+
+
+static bool screen_inverted = false, double_size_chars = false, scrollback_viewing = false;
 static uint8_t num_rows = 0, num_cols = 0, xborder = 0, yborder = 0;
 static bool is_dvi = true;
-static uint8_t color_map_inv[256];
 static uint16_t scroll_delay = 0;
 
-#define MKIDX(x, y) (((x)+xborder) + (((y)+yborder) * MAX_COLS))
+#define MKIDX(x, y) (((x)+xborder) + (framebuf_rowmap[(y)+yborder] * MAX_COLS))
+
+// one flag per display row and consumer, set whenever anything on the row
+// changes and cleared by framebuf_take_dirty_rows(). Byte flags (instead
+// of bits) can be set and cleared from different cores without locking.
+static volatile uint8_t dirty_rows[FRAMEBUF_DIRTY_NUM_CONSUMERS][64];
+
+
+static void mark_dirty(uint8_t y, uint8_t n)
+{
+  for(uint8_t i=0; i<FRAMEBUF_DIRTY_NUM_CONSUMERS; i++)
+    for(uint8_t j=0; j<n; j++)
+      dirty_rows[i][y+yborder+j] = 1;
+}
+
+
+static void mark_all_dirty()
+{
+  for(uint8_t i=0; i<FRAMEBUF_DIRTY_NUM_CONSUMERS; i++)
+    for(uint8_t j=0; j<64; j++)
+      dirty_rows[i][j] = 1;
+}
+
+
+uint64_t framebuf_take_dirty_rows(uint8_t consumer)
+{
+  // the flag is cleared before the caller looks at the row data so
+  // a change made while the row is being processed is not lost
+  uint64_t rows = 0;
+  volatile uint8_t *d = dirty_rows[consumer];
+  for(uint8_t i=0; i<64; i++)
+    if( d[i] ) { d[i] = 0; rows |= 1ull << i; }
+
+  return rows;
+}
+
+
+bool framebuf_is_row_dirty(uint8_t consumer, uint8_t row)
+{
+  // check (without clearing) whether a row has changed since the last
+  // call to framebuf_take_dirty_rows()
+  return dirty_rows[consumer][row]!=0;
+}
 
 
 static uint8_t mapcolor(uint8_t color16)
@@ -55,175 +117,188 @@ static uint8_t mapcolor(uint8_t color16)
 }
 
 
-static uint8_t mapcolor_inv(uint8_t fullcolor)
+static uint8_t rgbcolor(uint8_t r, uint8_t g, uint8_t b)
 {
-  return color_map_inv[fullcolor];
+  // nearest physical color for a 24-bit RGB color: 2 bits per channel
+  // for DVI (RRGGBB), 3/3/2 bits for VGA (RRRGGGBB)
+  if( is_dvi )
+    return ((r*3+127)/255) << 4 | ((g*3+127)/255) << 2 | ((b*3+127)/255);
+  else
+    return ((r*7+127)/255) << 5 | ((g*7+127)/255) << 2 | ((b*3+127)/255);
 }
 
 
-
-static void charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+static uint8_t xtermcolor(uint8_t color256)
 {
-  if( config_get_screen_monochrome() )
+  // physical color for colors 16-255 of the xterm 256-color palette:
+  // 6x6x6 color cube followed by 24 shades of grey
+  static const uint8_t cube[6] = {0, 95, 135, 175, 215, 255};
+  if( color256>=232 )
     {
-      fg = (a & ATTR_BOLD) ? config_get_screen_monochrome_textcolor_bold(is_dvi) : config_get_screen_monochrome_textcolor_normal(is_dvi);
-      bg = config_get_screen_monochrome_backgroundcolor(is_dvi);
+      uint8_t v = 8 + (color256-232)*10;
+      return rgbcolor(v, v, v);
     }
   else
     {
-      fg = mapcolor(fg);
-      bg = mapcolor(bg);
+      color256 -= 16;
+      return rgbcolor(cube[color256/36], cube[(color256/6)%6], cube[color256%6]);
     }
-  
-  if( screen_inverted )
-    { uint8_t c = fg; fg = bg; bg = c; }
+}
 
-  if( is_dvi )
-    return framebuf_dvi_charmemset(idx, c, a, fg, bg, n);
-  else
-    return framebuf_vga_charmemset(idx, c, a, fg, bg, n);
+
+// physical colors for the 256 terminal colors (16 configured colors
+// followed by the xterm 256-color palette) and the attribute used for
+// cleared areas, compiled from the settings by framebuf_apply_settings()
+// so the per-character operations do not query the configuration
+static struct
+{
+  uint8_t fg[256], bg[256];           // characters written to the screen
+  uint8_t fill_fg[256], fill_bg[256]; // cleared areas (not limited to 8 colors)
+  uint8_t fill_attr;
+} policy;
+
+
+static void compile_policy()
+{
+  // if there is no bold font then bold is shown as a bright color, so
+  // (except for PETSCII) characters only use the first 8 colors
+  bool mono = config_get_screen_monochrome();
+  uint8_t mask = (font_have_boldfont() || config_get_terminal_type()==CFG_TTYPE_PETSCII) ? 15 : 7;
+  for(int i=0; i<16; i++)
+    {
+      policy.fg[i]      = mono ? config_get_screen_monochrome_textcolor_normal(is_dvi) : mapcolor(i & mask);
+      policy.bg[i]      = mono ? config_get_screen_monochrome_backgroundcolor(is_dvi) : mapcolor(i & mask);
+      policy.fill_fg[i] = mono ? policy.fg[i] : mapcolor(i);
+      policy.fill_bg[i] = mono ? policy.bg[i] : mapcolor(i);
+    }
+
+  for(int i=16; i<256; i++)
+    {
+      policy.fg[i] = policy.fill_fg[i] = mono ? policy.fg[7] : xtermcolor(i);
+      policy.bg[i] = policy.fill_bg[i] = mono ? policy.bg[0] : xtermcolor(i);
+    }
+
+  policy.fill_attr = config_get_terminal_default_attr();
+}
+
+
+
+// operations provided by the DVI and VGA frame buffer backends, framebuf.c
+// calls these once per (block) operation instead of branching on is_dvi
+struct framebuf_backend
+{
+  void     (*charmemset)(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
+  void     (*charmemcpy)(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
+  void     (*charmemmove)(uint32_t toidx, uint32_t fromidx, size_t n);
+  void     (*charmemget)(uint32_t idx, uint32_t *buf, size_t n);
+  void     (*set_char)(uint32_t idx, uint8_t c);
+  uint8_t  (*get_char)(uint32_t idx);
+  void     (*set_attr)(uint32_t idx, uint8_t a);
+  uint8_t  (*get_attr)(uint32_t idx);
+  void     (*set_color)(uint32_t idx, uint8_t fg, uint8_t bg);
+  void     (*get_color)(uint32_t idx, uint8_t *fg, uint8_t *bg);
+  void     (*set_char_and_attr)(uint32_t idx, uint32_t c);
+  uint32_t (*get_char_and_attr)(uint32_t idx);
+  void     (*invert)();
+  void     (*set_page)(uint8_t *databuf, uint8_t *rowattr);
+  void     (*show_page)(uint8_t *databuf, uint8_t *rowattr);
+};
+
+static const struct framebuf_backend backend_dvi =
+  {
+    framebuf_dvi_charmemset, framebuf_dvi_charmemcpy, framebuf_dvi_charmemmove, framebuf_dvi_charmemget,
+    framebuf_dvi_set_char, framebuf_dvi_get_char, framebuf_dvi_set_attr, framebuf_dvi_get_attr,
+    framebuf_dvi_set_color, framebuf_dvi_get_color,
+    framebuf_dvi_set_char_and_attr, framebuf_dvi_get_char_and_attr, framebuf_dvi_invert,
+    framebuf_dvi_set_page, framebuf_dvi_show_page
+  };
+
+static const struct framebuf_backend backend_vga =
+  {
+    framebuf_vga_charmemset, framebuf_vga_charmemcpy, framebuf_vga_charmemmove, framebuf_vga_charmemget,
+    framebuf_vga_set_char, framebuf_vga_get_char, framebuf_vga_set_attr, framebuf_vga_get_attr,
+    framebuf_vga_set_color, framebuf_vga_get_color,
+    framebuf_vga_set_char_and_attr, framebuf_vga_get_char_and_attr, framebuf_vga_invert,
+    framebuf_vga_set_page, framebuf_vga_show_page
+  };
+
+static const struct framebuf_backend *backend = &backend_dvi;
+
+
+static void charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  backend->charmemset(idx, c, a, policy.fill_fg[fg], policy.fill_bg[bg], n);
+}
+
+
+static void charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  backend->charmemcpy(idx, chars, a, fg, bg, n);
 }
 
 
 static void charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
 {
-  if( is_dvi )
-    return framebuf_dvi_charmemmove(toidx, fromidx, n);
-  else
-    return framebuf_vga_charmemmove(toidx, fromidx, n);
+  backend->charmemmove(toidx, fromidx, n);
 }
 
 
-static void set_char_and_attr(uint32_t idx, uint32_t c)
+static void charmemget(uint32_t idx, uint32_t *buf, size_t n)
 {
-  if( is_dvi )
-    framebuf_dvi_set_char_and_attr(idx, c);
-  else
-    framebuf_vga_set_char_and_attr(idx, c);
+  backend->charmemget(idx, buf, n);
 }
 
 
-static uint32_t get_char_and_attr(uint32_t idx)
+static void set_char_and_attr(uint32_t idx, uint32_t c)
 {
-  if( is_dvi )
-    return framebuf_dvi_get_char_and_attr(idx);
-  else
-    return framebuf_vga_get_char_and_attr(idx);
+  backend->set_char_and_attr(idx, c);
 }
 
 
 static void set_char(uint32_t idx, uint8_t c)
 {
-  if( is_dvi )
-    framebuf_dvi_set_char(idx, c);
-  else
-    framebuf_vga_set_char(idx, c);
+  backend->set_char(idx, c);
 }
 
 
 static uint8_t get_char(uint32_t idx)
 {
-  if( is_dvi )
-    return framebuf_dvi_get_char(idx);
-  else
-    return framebuf_vga_get_char(idx);
+  return backend->get_char(idx);
 }
 
 
 static uint8_t get_attr(uint32_t idx)
 {
-  if( is_dvi )
-    return framebuf_dvi_get_attr(idx);
-  else
-    return framebuf_vga_get_attr(idx);
+  return backend->get_attr(idx);
 }
 
 
 static void set_fullcolor(uint32_t idx, uint8_t fg, uint8_t bg)
 {
-  bool char_inverted = (get_attr(idx) & ATTR_INVERSE)!=0;
-  if( char_inverted != screen_inverted )
-    { uint8_t c = fg; fg = bg; bg = c; }
-
-  if( is_dvi )
-    return framebuf_dvi_set_color(idx, fg, bg);
-  else
-    return framebuf_vga_set_color(idx, fg, bg);
+  backend->set_color(idx, fg, bg);
 }
 
 
-static void get_fullcolor(uint32_t idx, uint8_t *fg, uint8_t *bg)
+static void set_attr(uint32_t idx, uint8_t attr)
 {
-  bool char_inverted = (get_attr(idx) & ATTR_INVERSE)!=0;
-  if( char_inverted != screen_inverted )
-    { uint8_t *c = fg; fg = bg; bg = c; }
-  
-  if( is_dvi )
-    framebuf_dvi_get_color(idx, fg, bg);
-  else
-    framebuf_vga_get_color(idx, fg, bg);
+  // inverse and bold (as bright color) are applied by the video backends,
+  // so the colors passed to them do not change with the attributes
+  backend->set_attr(idx, attr);
 }
 
 
-static void set_attr(uint32_t idx, uint8_t attr)
+static void map_colors(uint8_t *fg, uint8_t *bg)
 {
-  uint8_t prev_attr = get_attr(idx);
-  
-  if( !font_have_boldfont() && (config_get_terminal_type()!=CFG_TTYPE_PETSCII) && (attr & ATTR_BOLD) != (prev_attr & ATTR_BOLD) )
-    {
-      // "bold" setting has changed and we are emulating bold via bright color setting
-      if( config_get_screen_monochrome() )
-        {
-          if( attr & ATTR_BOLD )
-            set_fullcolor(idx, config_get_screen_monochrome_textcolor_bold(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
-          else
-            set_fullcolor(idx, config_get_screen_monochrome_textcolor_normal(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
-        }
-      else
-        {
-          uint8_t fg, bg;
-          get_fullcolor(idx, &fg, &bg);
-          if( attr & ATTR_BOLD )
-            set_fullcolor(idx, mapcolor(mapcolor_inv(fg) | 8), bg);
-          else
-            set_fullcolor(idx, mapcolor(mapcolor_inv(fg) & 7), bg);
-        }
-    }
-  
-  if( (attr & ATTR_INVERSE) != (prev_attr & ATTR_INVERSE) )
-    {
-      // "inverse" setting has changed => swap fg/bg colors
-      uint8_t fg, bg;
-      get_fullcolor(idx, &fg, &bg);
-      set_fullcolor(idx,  bg,  fg);
-    }
-      
-  if( is_dvi )
-    framebuf_dvi_set_attr(idx, attr);
-  else
-    framebuf_vga_set_attr(idx, attr);
+  // computes the physical colors stored for terminal colors fg/bg
+  *fg = policy.fg[*fg];
+  *bg = policy.bg[*bg];
 }
 
 
 static void set_color(uint32_t idx, uint8_t fg, uint8_t bg)
 {
-  if( config_get_screen_monochrome() )
-    {
-      if( get_attr(idx) & ATTR_BOLD )
-        set_fullcolor(idx, config_get_screen_monochrome_textcolor_bold(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
-      else
-        set_fullcolor(idx, config_get_screen_monochrome_textcolor_normal(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
-    }
-  else
-    {
-      if( font_have_boldfont() || config_get_terminal_type()==CFG_TTYPE_PETSCII )
-        set_fullcolor(idx, mapcolor(fg), mapcolor(bg));
-      else
-        {
-          uint8_t bold = (get_attr(idx) & ATTR_BOLD) ? 8 : 0;
-          set_fullcolor(idx, mapcolor((fg & 7) | bold), mapcolor(bg & 7));
-        }
-    }
+  map_colors(&fg, &bg);
+  backend->set_color(idx, fg, bg);
 }
 
 
@@ -247,6 +322,7 @@ void framebuf_set_char(uint8_t x, uint8_t y, uint8_t c)
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
+      mark_dirty(y, double_size_chars ? 2 : 1);
       set_char(MKIDX(x, y), c);
       if( double_size_chars ) set_char(MKIDX(x, y+1), c);
     }
@@ -268,6 +344,7 @@ void framebuf_set_attr(uint8_t x, uint8_t y, uint8_t attr)
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
+      mark_dirty(y, double_size_chars ? 2 : 1);
       set_attr(MKIDX(x, y), attr);
       if( double_size_chars ) set_attr(MKIDX(x, y+1), attr);
     }
@@ -287,7 +364,10 @@ uint8_t framebuf_get_attr(uint8_t x, uint8_t y)
 void framebuf_set_row_attr(uint8_t row, uint8_t attr)
 {
   if( !double_size_chars && row<framebuf_get_nrows() && framebuf_rowattr[row+yborder]!=attr )
-    framebuf_rowattr[row+yborder] = attr;
+    {
+      framebuf_rowattr[row+yborder] = attr;
+      mark_dirty(row, 1);
+    }
 }
 
 
@@ -302,6 +382,7 @@ void framebuf_set_color(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg)
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
+      mark_dirty(y, double_size_chars ? 2 : 1);
       set_color(MKIDX(x, y), fg, bg);
       if( double_size_chars ) set_color(MKIDX(x, y+1), fg, bg);
     }
@@ -313,12 +394,37 @@ void framebuf_set_fullcolor(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg)
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
+      mark_dirty(y, double_size_chars ? 2 : 1);
       set_fullcolor(MKIDX(x, y), fg, bg);
       if( double_size_chars ) set_fullcolor(MKIDX(x, y+1), fg, bg);
     }
 }
 
 
+void framebuf_set_span(uint8_t x, uint8_t y, const uint8_t *chars, uint8_t n, uint8_t attr, uint8_t fg, uint8_t bg)
+{
+  if( double_size_chars ) y *= 2;
+  if( y < num_rows && x < framebuf_get_ncols(y) )
+    {
+      if( n > framebuf_get_ncols(y)-x ) n = framebuf_get_ncols(y)-x;
+      mark_dirty(y, double_size_chars ? 2 : 1);
+      map_colors(&fg, &bg);
+      charmemcpy(MKIDX(x, y), chars, attr, fg, bg, n);
+      if( double_size_chars ) charmemcpy(MKIDX(x, y+1), chars, attr, fg, bg, n);
+    }
+}
+
+
+void framebuf_set_cursor(uint8_t x, uint8_t y, uint8_t attr)
+{
+  if( double_size_chars ) y *= 2;
+  if( attr!=0 && y < num_rows && x < framebuf_get_ncols(y) )
+    framebuf_cursor = (x+xborder) | ((y+yborder) << 8) | ((double_size_chars ? 2 : 1) << 16) | ((uint32_t) attr << 24);
+  else
+    framebuf_cursor = 0;
+}
+
+
 void framebuf_fill_screen(char character, uint8_t fg, uint8_t bg)
 {
   framebuf_fill_region(0, 0, framebuf_get_ncols(-1)-1, framebuf_get_nrows()-1, character, fg, bg);
@@ -330,15 +436,17 @@ void framebuf_fill_region(uint8_t xs, uint8_t ys, uint8_t xe, uint8_t ye, char c
   if( double_size_chars ) { ys=ys*2; ye=ye*2+1; }
   if( ys < num_rows && xs < framebuf_get_ncols(ys) && ye < num_rows && xe < framebuf_get_ncols(ye) )
     {
+      if( ys<=ye ) mark_dirty(ys, ye-ys+1);
+
       if( xs>0 )
         {
-          charmemset(MKIDX(xs, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols-xs);
+          charmemset(MKIDX(xs, ys), c, policy.fill_attr, fg, bg, num_cols-xs);
           ys++;
         }
 
       if( xe<framebuf_get_ncols(ye)-1 )
         {
-          charmemset(MKIDX(0, ye), c, config_get_terminal_default_attr(), fg, bg, xe+1);
+          charmemset(MKIDX(0, ye), c, policy.fill_attr, fg, bg, xe+1);
           if( ye>0 )
             ye--;
           else
@@ -347,130 +455,319 @@ void framebuf_fill_region(uint8_t xs, uint8_t ys, uint8_t xe, uint8_t ye, char c
       
       while( ys<=ye )
         {
-          charmemset(MKIDX(0, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols);
+          charmemset(MKIDX(0, ys), c, policy.fill_attr, fg, bg, num_cols);
           ys++;
         }
     }
 }
 
 
+static void scrollback_capture_row(uint8_t y)
+{
+  uint32_t cells[80];
+  charmemget(MKIDX(0, y), cells, num_cols);
+  scrollback_add_line(framebuf_rowattr[y+yborder], cells, num_cols);
+}
+
+
+static void scrollback_show_row(uint16_t line, uint8_t y)
+{
+  uint32_t cells[80];
+  uint8_t  rowattr;
+  scrollback_get_line(line, cells, num_cols, &rowattr);
+  framebuf_rowattr[y+yborder] = rowattr;
+  mark_dirty(y, 1);
+  for(uint8_t x=0; x<num_cols; x++) set_char_and_attr(MKIDX(x, y), cells[x]);
+}
+
+
+static void scrollback_show(uint16_t offset)
+{
+  uint16_t first = scrollback_num_lines()-num_rows-offset;
+  for(uint8_t y=0; y<num_rows; y++) scrollback_show_row(first+y, y);
+}
+
+
+uint16_t framebuf_scrollback_view(uint16_t key)
+{
+  // The live screen is appended to the scrollback buffer while viewing.
+  // It is shown as the last page of the history and restored from there
+  // when leaving, so the terminal's screen contents are never lost (if the
+  // buffer is full this drops the oldest history lines).
+  // Serial input is not processed while viewing (like in the settings menu).
+  uint16_t offset = 0, step = double_size_chars ? 2 : 1;
+
+  uint32_t cursor = framebuf_cursor;
+  scrollback_viewing = true;
+  for(uint8_t y=0; y<num_rows; y++) scrollback_capture_row(y);
+  uint16_t maxoffset = scrollback_num_lines()-num_rows;
+
+  while( true )
+    {
+      uint16_t prev = offset;
+      switch( key & 0xFF )
+        {
+        case HID_KEY_PAGE_UP:    offset = MIN(offset+num_rows, maxoffset); break;
+        case HID_KEY_PAGE_DOWN:  offset = offset>num_rows ? offset-num_rows : 0; break;
+        case HID_KEY_ARROW_UP:   offset = MIN(offset+step, maxoffset); break;
+        case HID_KEY_ARROW_DOWN: offset = offset>step ? offset-step : 0; break;
+        case HID_KEY_HOME:       offset = maxoffset; break;
+        case HID_KEY_END:        offset = 0; break;
+        case HID_KEY_ESCAPE:     offset = 0; key = HID_KEY_NONE; break;
+        default:                 offset = 0; break;
+        }
+
+      if( offset!=prev ) 
+        {
+          framebuf_cursor = offset>0 ? 0 : cursor;
+          scrollback_show(offset);
+        }
+      if( offset==0 ) break;
+
+      while( keyboard_num_keypress()==0 ) wait(10);
+      key = keyboard_read_keypress();
+    }
+
+  // any key that is not a navigation key leaves the view and is returned
+  // so the caller can pass it on to the terminal
+  switch( key & 0xFF )
+    {
+    case HID_KEY_PAGE_UP: case HID_KEY_PAGE_DOWN: case HID_KEY_ARROW_UP:
+    case HID_KEY_ARROW_DOWN: case HID_KEY_HOME: case HID_KEY_END:
+      key = HID_KEY_NONE;
+      break;
+    }
+
+  scrollback_remove_lines(num_rows);
+  scrollback_viewing = false;
+  framebuf_cursor = cursor;
+  return key;
+}
+
+
+static void blank_span(uint32_t idx, uint8_t fg, uint8_t bg, size_t n)
+{
+  // clear n characters (no attributes) starting at frame buffer index idx
+  map_colors(&fg, &bg);
+  backend->charmemset(idx, ' ', 0, fg, bg, n);
+}
+
+
+static void clear_row(uint8_t y, uint8_t fg, uint8_t bg)
+{
+  charmemset(MKIDX(0, y), ' ', policy.fill_attr, fg, bg, num_cols);
+}
+
+
+static void rotate_rows(uint8_t start, uint8_t end, int8_t n)
+{
+  // rotate the row map entries for (physical) rows start..end by n rows
+  // (n>0: up, n<0: down), the frame buffer data itself does not move
+  uint8_t tmp[60];
+  if( n>0 )
+    {
+      memcpy(tmp, framebuf_rowmap+start, n);
+      memmove(framebuf_rowmap+start, framebuf_rowmap+start+n, end-start+1-n);
+      memcpy(framebuf_rowmap+end+1-n, tmp, n);
+    }
+  else if( n<0 )
+    {
+      n = -n;
+      memcpy(tmp, framebuf_rowmap+end+1-n, n);
+      memmove(framebuf_rowmap+start+n, framebuf_rowmap+start, end-start+1-n);
+      memcpy(framebuf_rowmap+start, tmp, n);
+    }
+}
+
+
 void framebuf_scroll_screen(int8_t n, uint8_t fg, uint8_t bg)
 {
   framebuf_scroll_region(0, framebuf_get_nrows()-1, n, fg, bg);
 }
 
 
-void framebuf_scroll_region(uint8_t start, uint8_t end, int8_t n, uint8_t fg, uint8_t bg)
+static void scroll_wait(int8_t n)
 {
-  if( double_size_chars ) {start *= 2; end=end*2+1; n *= 2; }
-  if( n!=0 && start<num_rows && end<num_rows )
+  // count the scroll, then hold it while scroll lock is on and apply
+  // the scroll delay (smooth scrolling)
+  stats.scrolls += n<0 ? -n : n;
+  if( config_get_keyboard_scroll_lock() && (keyboard_get_led_status() & KEYBOARD_LED_SCROLLLOCK)!=0 )
     {
-      if( config_get_keyboard_scroll_lock() && (keyboard_get_led_status() & KEYBOARD_LED_SCROLLLOCK)!=0 )
-        {
-          size_t n = keyboard_num_keypress();
-          while( (keyboard_get_led_status() & KEYBOARD_LED_SCROLLLOCK)!=0  )
-            { 
-              wait(10); 
-              if( keyboard_num_keypress()>n ) { sound_play_tone(880, 50, config_get_audible_bell_volume(), false); n=keyboard_num_keypress(); }
-            }
+      size_t n = keyboard_num_keypress();
+      while( (keyboard_get_led_status() & KEYBOARD_LED_SCROLLLOCK)!=0  )
+        { 
+          wait(10); 
+          if( keyboard_num_keypress()>n ) { sound_play_tone(880, 50, config_get_audible_bell_volume(), false); n=keyboard_num_keypress(); }
         }
+    }
+
+  if( scroll_delay>0 ) wait(scroll_delay);
+}
 
-      if( scroll_delay>0 ) wait(scroll_delay);
+
+void framebuf_scroll_region(uint8_t start, uint8_t end, int8_t n, uint8_t fg, uint8_t bg)
+{
+  if( double_size_chars ) {start *= 2; end=end*2+1; n *= 2; }
+  if( n!=0 && start<=end && end<num_rows )
+    {
+      scroll_wait(n);
+      PROFILE_BEGIN(profile_start);
+      mark_dirty(start, end-start+1);
 
       if( n>0 )
         {
-          // scrolling up
+          // scrolling up: clear the rows scrolled out at the top, then
+          // rotate them to the bottom of the region in the row map
+          if( n>end-start+1 ) n = end-start+1;
+          if( start==0 && current_page==0 && !scrollback_viewing && !config_menu_active() )
+            for(int y=0; y<n; y++)
+              scrollback_capture_row(y);
+          for(int y=0; y<n; y++)
+            clear_row(start+y, fg, bg);
+          
           if( n <= end-start )
             {
               if( !double_size_chars ) memmove(framebuf_rowattr+yborder+start, framebuf_rowattr+start+yborder+n, end-start+1-n);
-              for(int y=start; y<=end-n; y++)
-                charmemmove(MKIDX(0, y), MKIDX(0, y+n), MAX_COLS-xborder*2);
+              rotate_rows(start+yborder, end+yborder, n);
             }
           
-          if( n>end-start+1 ) n = end-start+1;
           if( !double_size_chars ) memset(framebuf_rowattr+(end+yborder+1-n), 0, n);
-          for(int y=0; y<n; y++)
-            charmemset(MKIDX(0, end+y+1-n), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
         }
       else if( n<0 )
         {
-          // scrolling down
+          // scrolling down: clear the rows scrolled out at the bottom, then
+          // rotate them to the top of the region in the row map
           n = -n;
+          if( n>end-start+1 ) n = end-start+1;
+          for(int i=0; i<n; i++)
+            clear_row(end-i, fg, bg);
+          
           if( n <= end-start )
             {
               if( !double_size_chars ) memmove(framebuf_rowattr+start+yborder+n, framebuf_rowattr+start+yborder, end-start+1-n);
-              for(int y=end-n; y>=start; y--)
-                charmemmove(MKIDX(0, y+n), MKIDX(0, y), MAX_COLS-xborder*2);
+              rotate_rows(start+yborder, end+yborder, -n);
             }
           
-          if( n>end-start+1 ) n = end-start+1;
           if( !double_size_chars ) memset(framebuf_rowattr+start+yborder, 0, n);
-          for(int i=0; i<n; i++)
-            charmemset(MKIDX(0, start+i), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
         }
+
+      PROFILE_END(PROF_SCROLL_REGION, profile_start);
     }
 }
 
 
-void framebuf_insert(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
+void framebuf_scroll_rect(uint8_t xs, uint8_t ys, uint8_t xe, uint8_t ye, int8_t n, uint8_t fg, uint8_t bg)
 {
-  if( double_size_chars ) y *= 2;
-  if( y < num_rows && x < framebuf_get_ncols(y) )
+  // same as framebuf_scroll_region but only columns xs..xe move, so rows
+  // can not simply be rotated in the row map: each row of the rectangle
+  // is moved with a single block move instead
+  if( double_size_chars ) { ys *= 2; ye=ye*2+1; n *= 2; }
+  if( n!=0 && ys<=ye && ye<num_rows && xs<=xe && xe<num_cols )
     {
-      for(int i=0; i<((int) num_cols)-(x+n); i++)
+      size_t w = xe-xs+1;
+      scroll_wait(n);
+      PROFILE_BEGIN(profile_start);
+      mark_dirty(ys, ye-ys+1);
+
+      if( n>0 )
         {
-          int col = num_cols-i-1;
-          set_char_and_attr(MKIDX(col, y), get_char_and_attr(MKIDX(col-n, y)));
-          if( double_size_chars ) set_char_and_attr(MKIDX(col, y+1), get_char_and_attr(MKIDX(col-n, y+1)));
+          if( n>ye-ys+1 ) n = ye-ys+1;
+          for(int y=ys; y+n<=ye; y++)
+            charmemmove(MKIDX(xs, y), MKIDX(xs, y+n), w);
+          for(int y=ye+1-n; y<=ye; y++)
+            charmemset(MKIDX(xs, y), ' ', policy.fill_attr, fg, bg, w);
         }
-      
-      for(int i=0; i<n && x+i<num_cols; i++)
+      else
         {
-          uint32_t idx = MKIDX(x+i, y);
-          set_char(idx, ' ');
-          set_attr(idx, 0);
-          set_color(idx, fg, bg);
-          if( double_size_chars )
-            {
-              idx += MAX_COLS;
-              set_char(idx, ' ');
-              set_attr(idx, 0);
-              set_color(idx, fg, bg);
-            }
+          n = -n;
+          if( n>ye-ys+1 ) n = ye-ys+1;
+          for(int y=ye; y-n>=ys; y--)
+            charmemmove(MKIDX(xs, y), MKIDX(xs, y-n), w);
+          for(int y=ys; y<ys+n; y++)
+            charmemset(MKIDX(xs, y), ' ', policy.fill_attr, fg, bg, w);
         }
+
+      PROFILE_END(PROF_SCROLL_REGION, profile_start);
     }
 }
 
 
-void framebuf_delete(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
+void framebuf_insert(uint8_t x, uint8_t xe, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
 {
   if( double_size_chars ) y *= 2;
-  if( y < num_rows && x < framebuf_get_ncols(y) )
+  if( xe >= num_cols ) xe = num_cols-1;
+  if( y < num_rows && x < framebuf_get_ncols(y) && x <= xe )
     {
-      for(int i=0; i<((int) num_cols)-(x+n); i++)
+      mark_dirty(y, double_size_chars ? 2 : 1);
+      if( n > xe+1-x ) n = xe+1-x;
+      for(uint8_t r=y; r<=y+(double_size_chars ? 1 : 0); r++)
         {
-          set_char_and_attr(MKIDX(x+i, y), get_char_and_attr(MKIDX(x+n+i, y)));
-          if( double_size_chars ) set_char_and_attr(MKIDX(x+i, y+1), get_char_and_attr(MKIDX(x+n+i, y+1)));
+          charmemmove(MKIDX(x+n, r), MKIDX(x, r), xe+1-(x+n));
+          blank_span(MKIDX(x, r), fg, bg, n);
         }
-      
-      for(int i=0; i<n && i<num_cols-x; i++)
+    }
+}
+
+
+void framebuf_delete(uint8_t x, uint8_t xe, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
+{
+  if( double_size_chars ) y *= 2;
+  if( xe >= num_cols ) xe = num_cols-1;
+  if( y < num_rows && x < framebuf_get_ncols(y) && x <= xe )
+    {
+      mark_dirty(y, double_size_chars ? 2 : 1);
+      if( n > xe+1-x ) n = xe+1-x;
+      for(uint8_t r=y; r<=y+(double_size_chars ? 1 : 0); r++)
         {
-          uint32_t idx = MKIDX(num_cols-1-i, y);
-          set_char(idx, ' ');
-          set_attr(idx, 0);
-          set_color(idx, fg, bg);
-          if( double_size_chars )
-            {
-              idx += MAX_COLS;
-              set_char(idx, ' ');
-              set_attr(idx, 0);
-              set_color(idx, fg, bg);
-            }
+          charmemmove(MKIDX(x, r), MKIDX(x+n, r), xe+1-(x+n));
+          blank_span(MKIDX(xe+1-n, r), fg, bg, n);
         }
     }
 }
 
 
+static void select_page(uint8_t page)
+{
+  current_page     = page;
+  framebuf_data    = framebuf_pages[page];
+  framebuf_rowattr = framebuf_page_rowattr[page];
+  framebuf_rowmap  = framebuf_rowattr+FRAMEBUF_ROWMAP_OFFSET;
+  backend->set_page(framebuf_data, framebuf_rowattr);
+}
+
+
+void framebuf_set_page(uint8_t page)
+{
+  // select the screen page that all following operations work on,
+  // this does not change which page is shown
+  if( page<FRAMEBUF_NUM_PAGES && page!=current_page )
+    select_page(page);
+}
+
+
+void framebuf_show_page(uint8_t page)
+{
+  // show a different screen page, only the buffer pointers in the video
+  // backend change so the contents of all pages are kept
+  if( page<FRAMEBUF_NUM_PAGES && page!=shown_page )
+    {
+      // the VGA backend keeps the screen inversion in the data of the
+      // shown page, so it is undone on the old page and applied to the new one
+      if( screen_inverted ) backend->invert();
+      shown_page = page;
+      backend->show_page(framebuf_pages[page], framebuf_page_rowattr[page]);
+      if( screen_inverted ) backend->invert();
+      mark_all_dirty();
+    }
+}
+
+
+uint8_t framebuf_get_page()
+{
+  return current_page;
+}
+
+
 void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows)
 {
   if( nrows>MAX_ROWS ) nrows = MAX_ROWS;
@@ -478,9 +775,8 @@ void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows)
 
   if( num_rows!=nrows || num_cols!=ncols )
     {
-      screen_inverted = false;
-      charmemset(0, ' ', config_get_terminal_default_attr(), config_get_terminal_default_fg(), config_get_terminal_default_bg(), MAX_ROWS * MAX_COLS);
-      memset(framebuf_rowattr, 0, MAX_ROWS);
+      framebuf_set_screen_inverted(false);
+      scrollback_clear();
 
       double_size_chars = (ncols*8*2)<=FRAME_WIDTH && (nrows*font_get_char_height()*2)<=FRAME_HEIGHT && config_get_screen_dblchars();
       if( double_size_chars )
@@ -489,8 +785,6 @@ void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows)
           num_cols = ncols;
           xborder = (MAX_COLS-ncols*2)/4;
           yborder = (MAX_ROWS-nrows*2)/2;
-          for(int i=0; i<num_rows; i++)
-            framebuf_rowattr[i+yborder] = ROW_ATTR_DBL_WIDTH | ((i&1) ? ROW_ATTR_DBL_HEIGHT_BOT : ROW_ATTR_DBL_HEIGHT_TOP);
         }
       else
         {
@@ -499,6 +793,18 @@ void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows)
           xborder = (MAX_COLS-ncols)/2;
           yborder = (MAX_ROWS-nrows)/2;
         }
+
+      // clear all pages, ending up on the first one
+      for(int page=FRAMEBUF_NUM_PAGES-1; page>=0; page--)
+        {
+          select_page(page);
+          charmemset(0, ' ', config_get_terminal_default_attr(), config_get_terminal_default_fg(), config_get_terminal_default_bg(), MAX_ROWS * MAX_COLS);
+          memset(framebuf_rowattr, 0, MAX_ROWS);
+          for(int i=0; i<60; i++) framebuf_rowmap[i] = i;
+          if( double_size_chars )
+            for(int i=0; i<num_rows; i++)
+              framebuf_rowattr[i+yborder] = ROW_ATTR_DBL_WIDTH | ((i&1) ? ROW_ATTR_DBL_HEIGHT_BOT : ROW_ATTR_DBL_HEIGHT_TOP);
+        }
     }
 }
 
@@ -507,12 +813,9 @@ void framebuf_set_screen_inverted(bool invert)
 {
   if( invert != screen_inverted )
     {
-      if( is_dvi )
-	framebuf_dvi_invert();
-      else
-	framebuf_vga_invert();
-      
+      backend->invert();
       screen_inverted = invert;
+      mark_all_dirty();
     }
 }
 
@@ -544,10 +847,26 @@ bool framebuf_is_dvi()
 void framebuf_apply_settings()
 {
   font_apply_settings();
-  memset(framebuf_data, 0, sizeof(framebuf_data));
+  framebuf_show_page(0);
+  framebuf_set_page(0);
+  compile_policy();
+
+  // bold characters are shown in the bold text color (monochrome) or as
+  // bright colors if there is no bold font (before clearing the screen
+  // since the VGA backend stores the colors as shown)
+  for(int i=0; i<256; i++) framebuf_bold_color[i] = i;
+  if( config_get_screen_monochrome() )
+    framebuf_bold_color[config_get_screen_monochrome_textcolor_normal(is_dvi)] = config_get_screen_monochrome_textcolor_bold(is_dvi);
+  else if( !font_have_boldfont() && config_get_terminal_type()!=CFG_TTYPE_PETSCII )
+    for(int i=0; i<8; i++) framebuf_bold_color[mapcolor(i)] = mapcolor(i | 8);
+  for(int i=0; i<256; i++) framebuf_bold_color_inv[i] = i;
+  for(int i=0; i<256; i++)
+    if( framebuf_bold_color[i]!=i )
+      framebuf_bold_color_inv[framebuf_bold_color[i]] = i;
+
+  memset(framebuf_pages, 0, sizeof(framebuf_pages));
   framebuf_set_screen_size(config_get_screen_cols(), config_get_screen_rows());
-  for(int i=0; i<256; i++) color_map_inv[i] = 0;
-  for(int i=0; i<16; i++)  color_map_inv[mapcolor(i)] = i;
+  mark_all_dirty();
   scroll_delay = 0;
 }
 
@@ -568,13 +887,21 @@ void framebuf_init(bool forceDVI)
     is_dvi = config_get_screen_display()==1;
   
   font_init();
-  memset(framebuf_data, 0, sizeof(framebuf_data));
+  memset(framebuf_pages, 0, sizeof(framebuf_pages));
+  for(int page=0; page<FRAMEBUF_NUM_PAGES; page++)
+    for(int i=0; i<60; i++) framebuf_page_rowattr[page][FRAMEBUF_ROWMAP_OFFSET+i] = i;
   screen_inverted = false;
 
   if( is_dvi )
-    framebuf_dvi_init(framebuf_data, framebuf_rowattr);
+    {
+      backend = &backend_dvi;
+      framebuf_dvi_init(framebuf_data, framebuf_rowattr);
+    }
   else
-    framebuf_vga_init(framebuf_data, framebuf_rowattr);
+    {
+      backend = &backend_vga;
+      framebuf_vga_init(framebuf_data, framebuf_rowattr);
+    }
 
   framebuf_apply_settings();
 
@@ -37,6 +37,14 @@
 #define ROW_ATTR_DBL_HEIGHT_TOP  0x02
 #define ROW_ATTR_DBL_HEIGHT_BOT  0x04
 
+// the row attribute buffer passed to the video backends is followed
+// (at this offset) by the row map which gives the frame buffer row
+// holding the data for each display row
+#define FRAMEBUF_ROWMAP_OFFSET   64
+
+// number of screen pages (normal and alternate screen for two consoles)
+#define FRAMEBUF_NUM_PAGES 4
+
 void framebuf_init(bool forceDVI);
 void framebuf_apply_settings();
 bool framebuf_is_dvi();
@@ -50,17 +58,30 @@ uint8_t framebuf_get_attr(uint8_t column, uint8_t row);
 void    framebuf_set_row_attr(uint8_t row, uint8_t a);
 uint8_t framebuf_get_row_attr(uint8_t row);
 
+// terminal colors: 0-15 are the configured colors, 16-255 the xterm
+// 256-color palette (mapped to the nearest color the display can show)
 void framebuf_set_color(uint8_t column, uint8_t row, uint8_t foreground, uint8_t background);
 void framebuf_set_fullcolor(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg);
 
+// write n characters with the same attributes and colors to consecutive columns of a row
+void framebuf_set_span(uint8_t column, uint8_t row, const uint8_t *chars, uint8_t n, uint8_t attr, uint8_t fg, uint8_t bg);
+
+// show the cursor at the given position by toggling attributes "attr" of
+// the character there when displaying it (attr=0 hides the cursor)
+void framebuf_set_cursor(uint8_t column, uint8_t row, uint8_t attr);
+
 void framebuf_fill_screen(char character, uint8_t fg, uint8_t bg);
 void framebuf_fill_region(uint8_t col_start, uint8_t row_start, uint8_t col_end, uint8_t row_end, char character, uint8_t fg, uint8_t bg);
 
 void framebuf_scroll_screen(int8_t n, uint8_t fg, uint8_t bg);
 void framebuf_scroll_region(uint8_t row_start, uint8_t row_end, int8_t n, uint8_t fg, uint8_t bg);
 
-void framebuf_insert(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg);
-void framebuf_delete(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg);
+// scroll only columns col_start..col_end of rows row_start..row_end (left/right margins)
+void framebuf_scroll_rect(uint8_t col_start, uint8_t row_start, uint8_t col_end, uint8_t row_end, int8_t n, uint8_t fg, uint8_t bg);
+
+// insert/delete n characters at column x of row y, shifting columns x..x_end
+void framebuf_insert(uint8_t x, uint8_t x_end, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg);
+void framebuf_delete(uint8_t x, uint8_t x_end, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg);
 
 uint8_t framebuf_get_nrows();
 uint8_t framebuf_get_ncols(int row);
@@ -68,6 +89,22 @@ uint8_t framebuf_get_ncols(int row);
 void framebuf_set_scroll_delay(uint16_t ms);
 void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows);
 void framebuf_set_screen_inverted(bool invert);
+void framebuf_set_page(uint8_t page);
+void framebuf_show_page(uint8_t page);
+uint8_t framebuf_get_page();
 void framebuf_flash_screen(uint8_t color, uint8_t nframes);
 
+// Dirty row tracking: each consumer gets a bitmap of the display rows
+// (bit n = row n of the frame, including border rows) that have changed
+// since its previous call. Must be called before reading the row data.
+// The video renderer (DVI) is the only consumer so far.
+#define FRAMEBUF_DIRTY_VIDEO          0
+#define FRAMEBUF_DIRTY_NUM_CONSUMERS  1
+uint64_t framebuf_take_dirty_rows(uint8_t consumer);
+bool     framebuf_is_row_dirty(uint8_t consumer, uint8_t row);
+
+// show lines that have scrolled off the top of the screen, starting with the
+// given (navigation) key and returning the key that ended viewing (or HID_KEY_NONE)
+uint16_t framebuf_scrollback_view(uint16_t key);
+
 #endif
@@ -35,6 +35,7 @@
 #include "framebuf_dvi.h"
 #include "font.h"
 #include "config.h"
+#include "profile.h"
 
 #define DVI_TIMING             dvi_timing_640x480p_60hz
 #define COLOR_PLANE_SIZE_WORDS (MAX_ROWS * MAX_COLS * 4 / 32)
@@ -42,64 +43,126 @@
 // defined in framebuf.c
 extern int16_t framebuf_flash_counter;
 extern uint8_t framebuf_flash_color;
+extern uint8_t framebuf_bold_color[256];
+extern volatile uint32_t framebuf_cursor;
 
 struct dvi_inst dvi0;
+// page modified by the frame buffer operations
 static uint16_t *charbuf  = NULL;
 static uint32_t *colorbuf = NULL;
-static uint8_t  *rowattr  = NULL;
 
+// page shown on screen (used by core1)
+static uint16_t *showchars  = NULL;
+static uint32_t *showcolors = NULL;
+static uint8_t  *rowattr    = NULL;
+static uint8_t  *rowmap     = NULL;
+static bool      inverted = false;
+
+// colors as shown on screen (after applying bold, inverse and screen inversion),
+// same layout as colorbuf (sized for 60 rows), updated by core1 for changed rows
+static uint32_t rendercolor[60 * 80 * 4 / 32 * 3];
 
-void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
-{
-  uint16_t v = c | (a<<8);
-  for(size_t i=0; i<n; i++) charbuf[idx+i] = v;
 
-  if( (idx&1)==1 ) { framebuf_dvi_set_color(idx, fg, bg); idx++; n--; }
-  if( (n&1)==1   ) { framebuf_dvi_set_color(idx+n, fg, bg); n--; }
-  
-  if( n>0 )
-    for(int plane=0; plane<3; plane++) 
-      {
-        uint8_t fg_bg_combined = (fg & 0x3) | ((bg << 2) & 0xc);
-        fg_bg_combined |= fg_bg_combined << 4;
-        memset((uint8_t *) colorbuf+plane*COLOR_PLANE_SIZE_WORDS*sizeof(uint32_t)+idx/2, fg_bg_combined, n/2);
-        fg >>= 2;
-        bg >>= 2;
-      }
+static inline uint32_t nibble_mask(uint32_t w, uint32_t first, uint32_t last, uint32_t lo, uint32_t hi)
+{
+  // mask for the 4-bit values within word w that are part of a range which
+  // starts at nibble "lo" of word "first" and ends before nibble "hi" of word "last"
+  uint32_t mask = 0xFFFFFFFF;
+  if( w==first ) mask &= 0xFFFFFFFF << (lo*4);
+  if( w==last && hi<8 ) mask &= ~(0xFFFFFFFF << (hi*4));
+  return mask;
 }
 
 
-void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+static void fill_nibbles(uint32_t *p, uint32_t idx, uint32_t v, size_t n)
 {
-  memmove(charbuf+toidx, charbuf+fromidx, n*2);
-  if( (fromidx&1)==0 && (toidx&1)==0 && (n&1)==0 )
+  // set n 4-bit values (8 per word, least significant first) starting at index
+  // idx to the 4-bit value v
+  if( n==0 ) return;
+
+  uint32_t first = idx/8, last = (idx+n-1)/8;
+  uint32_t lo    = idx%8, hi = (idx+n-1)%8 + 1;
+  v *= 0x11111111;
+  for(uint32_t w=first; w<=last; w++)
     {
-      for(int plane = 0; plane < 3; plane++)
-        memmove((uint8_t *) colorbuf+plane*COLOR_PLANE_SIZE_WORDS*sizeof(uint32_t)+toidx/2,
-                (uint8_t *) colorbuf+plane*COLOR_PLANE_SIZE_WORDS*sizeof(uint32_t)+fromidx/2,
-                n/2);
+      uint32_t mask = nibble_mask(w, first, last, lo, hi);
+      p[w] = (p[w] & ~mask) | (v & mask);
     }
-  else if( fromidx>toidx )
+}
+
+
+static void set_color_range(uint32_t idx, uint8_t fg, uint8_t bg, size_t n)
+{
+  for(int plane=0; plane<3; plane++) 
     {
-      uint8_t fg, bg;
-      for(int i=0; i<n; i++)
-        {
-          framebuf_dvi_get_color(fromidx+i, &fg, &bg);
-          framebuf_dvi_set_color(toidx+i, fg, bg);
-        }
+      fill_nibbles(colorbuf+plane*COLOR_PLANE_SIZE_WORDS, idx, (fg & 0x3) | ((bg << 2) & 0xc), n);
+      fg >>= 2;
+      bg >>= 2;
     }
-  else if( fromidx<toidx )
+}
+
+
+void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint16_t v = c | (a<<8);
+  for(size_t i=0; i<n; i++) charbuf[idx+i] = v;
+  set_color_range(idx, fg, bg, n);
+}
+
+
+void framebuf_dvi_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint16_t *buf = charbuf+idx;
+  uint16_t  v   = a<<8;
+  for(size_t i=0; i<n; i++) buf[i] = v | chars[i];
+  set_color_range(idx, fg, bg, n);
+}
+
+
+static void move_nibbles(uint32_t *p, uint32_t to, uint32_t from, size_t n)
+{
+  // Move n 4-bit values (8 per word, least significant first) from index "from"
+  // to index "to", overlapping ranges are handled like memmove. Works on whole
+  // words: each destination word is assembled from (at most) two source words.
+  // May read (but not use) the word following the source range.
+  if( n==0 || to==from ) return;
+
+  int32_t  delta = (int32_t) from - (int32_t) to;
+  uint32_t first = to/8, last = (to+n-1)/8;
+  uint32_t lo    = to%8, hi = (to+n-1)%8 + 1;
+
+  // move forward if the source is above the destination, backward otherwise,
+  // so source words are always read before they are overwritten
+  int32_t  step = delta>0 ? 1 : -1;
+  uint32_t w    = delta>0 ? first : last;
+  for(uint32_t i=first; i<=last; i++, w+=step)
     {
-      uint8_t fg, bg;
-      for(int i=n-1; i>=0; i--)
-        {
-          framebuf_dvi_get_color(fromidx+i, &fg, &bg);
-          framebuf_dvi_set_color(toidx+i, fg, bg);
-        }
+      int32_t  sidx  = (int32_t) (w*8) + delta;
+      int32_t  q     = sidx >> 3;
+      uint32_t shift = (sidx & 7) * 4;
+      uint32_t v     = q>=0 ? p[q] : 0;
+      if( shift>0 ) v = (v >> shift) | (p[q+1] << (32-shift));
+
+      uint32_t mask = nibble_mask(w, first, last, lo, hi);
+      p[w] = (p[w] & ~mask) | (v & mask);
     }
 }
 
 
+void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+{
+  memmove(charbuf+toidx, charbuf+fromidx, n*2);
+  for(int plane = 0; plane < 3; plane++)
+    move_nibbles(colorbuf+plane*COLOR_PLANE_SIZE_WORDS, toidx, fromidx, n);
+}
+
+
+void framebuf_dvi_charmemget(uint32_t idx, uint32_t *buf, size_t n)
+{
+  for(size_t i=0; i<n; i++) buf[i] = framebuf_dvi_get_char_and_attr(idx+i);
+}
+
+
 uint8_t framebuf_dvi_get_char(uint32_t idx)
 {
   return charbuf[idx] & 255;
@@ -125,12 +188,8 @@ void framebuf_dvi_set_attr(uint32_t idx, uint8_t a)
 
 void framebuf_dvi_invert()
 {
-  uint32_t s = COLOR_PLANE_SIZE_WORDS*3;
-  for(uint32_t i=0; i<s; i++)
-    {
-      uint32_t c = colorbuf[i];
-      colorbuf[i] = ((c & 0x33333333)<<2) | ((c & 0xCCCCCCCC)>>2);
-    }
+  // applied when rows are rendered, framebuf.c marks all rows as changed
+  inverted = !inverted;
 }
 
 
@@ -185,16 +244,127 @@ uint32_t framebuf_dvi_get_char_and_attr(uint32_t idx)
 }
 
 
+static bool __not_in_flash_func(row_is_uniform)(uint row)
+{
+  // a row is uniform if all its (visible) characters, attributes and colors are the same
+  uint prow = rowmap[row];
+  uint n    = (rowattr[row] & ROW_ATTR_DBL_WIDTH) ? MAX_COLS/2 : MAX_COLS;
+  const uint16_t *c = showchars + prow * MAX_COLS;
+  for(uint i=1; i<n; i++)
+    if( c[i]!=c[0] )
+      return false;
+
+  for(int plane = 0; plane < 3; ++plane)
+    {
+      const uint32_t *col = showcolors + prow * (COLOR_PLANE_SIZE_WORDS / MAX_ROWS) + plane * COLOR_PLANE_SIZE_WORDS;
+      if( col[0] != (col[0] & 0x0F) * 0x11111111 ) return false;
+      for(uint i=1; i<n/8; i++)
+        if( col[i]!=col[0] )
+          return false;
+    }
+
+  return true;
+}
+
+
+static void __not_in_flash_func(render_row_colors)(uint row)
+{
+  // compute the colors shown for a row: bold characters get their foreground
+  // color from framebuf_bold_color, inverse characters (or all characters
+  // if the screen is inverted) get foreground and background swapped
+  uint32_t wpr  = COLOR_PLANE_SIZE_WORDS / MAX_ROWS;
+  uint32_t cpw  = COLOR_PLANE_SIZE_WORDS;
+  uint     prow = rowmap[row];
+  const uint16_t *c   = showchars + prow * MAX_COLS;
+  const uint32_t *src = showcolors + prow * wpr;
+  uint32_t       *dst = rendercolor + prow * wpr;
+  uint32_t scrinv = inverted ? 0xFFFFFFFF : 0;
+
+  for(uint w=0; w<wpr; w++, c+=8)
+    {
+      uint32_t c0 = src[w], c1 = src[w+cpw], c2 = src[w+2*cpw], inv = 0;
+      for(uint i=0; i<8; i++)
+        {
+          uint a = c[i] >> 8;
+          if( a & ATTR_INVERSE ) inv |= 0xFu << (i*4);
+          if( a & ATTR_BOLD )
+            {
+              uint sh = i*4;
+              uint fg = ((c0 >> sh) & 3) | (((c1 >> sh) & 3) << 2) | (((c2 >> sh) & 3) << 4);
+              fg = framebuf_bold_color[fg];
+              uint32_t m = ~(3u << sh);
+              c0 = (c0 & m) | ((fg & 3) << sh);
+              c1 = (c1 & m) | (((fg >> 2) & 3) << sh);
+              c2 = (c2 & m) | (((fg >> 4) & 3) << sh);
+            }
+        }
+
+      // swap the 2-bit foreground and background fields of inverted characters
+      inv ^= scrinv;
+      dst[w]       = (c0 & ~inv) | ((((c0 & 0x33333333) << 2) | ((c0 >> 2) & 0x33333333)) & inv);
+      dst[w+cpw]   = (c1 & ~inv) | ((((c1 & 0x33333333) << 2) | ((c1 >> 2) & 0x33333333)) & inv);
+      dst[w+2*cpw] = (c2 & ~inv) | ((((c2 & 0x33333333) << 2) | ((c2 >> 2) & 0x33333333)) & inv);
+    }
+}
+
+
+static void __not_in_flash_func(render_cursor_row)(uint row, uint col, uint8_t attr, uint16_t *chars, uint32_t *colors)
+{
+  // make a copy of a row's characters and colors (planes stored consecutively)
+  // with the cursor attributes applied to the character at column "col"
+  uint32_t wpr  = COLOR_PLANE_SIZE_WORDS / MAX_ROWS;
+  uint32_t cpw  = COLOR_PLANE_SIZE_WORDS;
+  uint     prow = rowmap[row];
+  memcpy(chars, showchars + prow * MAX_COLS, MAX_COLS * sizeof(uint16_t));
+  chars[col] ^= attr << 8;
+
+  for(int plane = 0; plane < 3; ++plane)
+    {
+      uint32_t *c = colors + plane * wpr;
+      memcpy(c, rendercolor + prow * wpr + plane * cpw, wpr * sizeof(uint32_t));
+      if( attr & ATTR_INVERSE )
+        {
+          // swap the 2-bit foreground and background fields at the cursor
+          uint32_t m = 0xFu << ((col % 8) * 4);
+          uint32_t v = c[col / 8];
+          c[col / 8] = (v & ~m) | ((((v & 0x33333333) << 2) | ((v >> 2) & 0x33333333)) & m);
+        }
+    }
+}
+
+
+static void __not_in_flash_func(tmds_repeat_char)(uint32_t *buf, uint n_words)
+{
+  // the first 8 words of buf hold the TMDS symbols for one (double-width) or
+  // two (single-width) characters, repeat them across the rest of the line
+  uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+  uint32_t e = buf[4], f = buf[5], g = buf[6], h = buf[7];
+  for(uint i=8; i<n_words; i+=8)
+    {
+      buf[i+0] = a; buf[i+1] = b; buf[i+2] = c; buf[i+3] = d;
+      buf[i+4] = e; buf[i+5] = f; buf[i+6] = g; buf[i+7] = h;
+    }
+}
+
+
 void __not_in_flash_func(core1_main)() 
 {
   uint32_t *tmdsbuf;
   dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
   dvi_start(&dvi0);
+#ifdef VERSATERM_PROFILE
+  profile_init_core();
+#endif
 
   uint8_t frameCtr = 0;
   const uint8_t* font = font_get_data_blinkon();
   static uint32_t solidcolor[MAX_COLS * 4 / 32];
+  static uint16_t cursorchars[MAX_COLS];
+  static uint32_t cursorcolor[MAX_COLS * 4 / 32 * 3];
+  static bool row_uniform[64];
+  uint64_t prev_dirty = 0;
   memset(solidcolor, 0, sizeof(solidcolor));
+  memset(row_uniform, 0, sizeof(row_uniform));
 
   while( true )
     {
@@ -222,50 +392,104 @@ void __not_in_flash_func(core1_main)()
       uint32_t color_plane_size_words    = COLOR_PLANE_SIZE_WORDS;
       uint32_t color_plane_words_per_row = COLOR_PLANE_SIZE_WORDS / MAX_ROWS;
       uint32_t num_y                     = font_get_char_height()*MAX_ROWS;
+
+      // rows that changed since the last frame (or the one before, in case
+      // a change was still being written while the row was processed) get
+      // their colors re-computed and re-checked for uniformity here, before
+      // the first scanline of the frame: the last scanlines of the previous
+      // frame are already encoded so this runs during vertical blanking
+      // instead of taking time from the encoding of any scanline
+      uint64_t dirty = framebuf_take_dirty_rows(FRAMEBUF_DIRTY_VIDEO);
+      uint64_t update = dirty | prev_dirty;
+      prev_dirty = dirty;
+      PROFILE_BEGIN(profile_rows);
+      for(uint row = 0; row < MAX_ROWS; row++)
+        if( update & (1ull << row) )
+          {
+            render_row_colors(row);
+            row_uniform[row] = row_is_uniform(row);
+          }
+      PROFILE_END(PROF_DVI_ROWS, profile_rows);
+
+      // the cursor is drawn on top of the frame buffer contents by rendering
+      // its row(s) from a copy that has the cursor attributes applied
+      uint32_t cursor      = framebuf_cursor;
+      uint8_t  cursor_attr = cursor >> 24;
+      uint     cursor_col  = cursor & 0xFF;
+      uint     cursor_row  = (cursor >> 8) & 0xFF;
+      uint     cursor_rows = cursor_attr ? ((cursor >> 16) & 0xFF) : 0;
         
       for(uint y = 0; y < FRAME_HEIGHT; ++y)
         {
           queue_remove_blocking(&dvi0.q_tmds_free, &tmdsbuf);
+          PROFILE_BEGIN(profile_start);
+
+          uint row  = y / char_height;
+          uint prow = rowmap[row];
 
-          uint row = y / char_height;
+          bool at_cursor = y<num_y && row>=cursor_row && row<cursor_row+cursor_rows;
+          if( at_cursor && (y % char_height)==0 )
+            render_cursor_row(row, cursor_col, cursor_attr, cursorchars, cursorcolor);
           
           void (*tmds_encode_font_2bpp)(const uint16_t *, const uint32_t *, uint32_t *, uint, const uint8_t *) = 
             (rowattr[row] & ROW_ATTR_DBL_WIDTH) ? tmds_encode_font_2bpp_dw : tmds_encode_font_2bpp_sw;
 
+          const uint8_t *font_line;
           if( rowattr[row] & ROW_ATTR_DBL_HEIGHT_TOP )
-            {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(y % char_height)/2 * 256 * 8]);
-            }
+            font_line = &font[(y % char_height)/2 * 256 * 8];
           else if( rowattr[row] & ROW_ATTR_DBL_HEIGHT_BOT )
-            {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(((y % char_height)+char_height))/2 * 256 * 8]);
-            }
+            font_line = &font[(((y % char_height)+char_height))/2 * 256 * 8];
           else
+            font_line = &font[(y % char_height) * 256 * 8];
+
+          // for uniform rows only encode one block of 8 characters and repeat it
+          // (unless the row has changed since it was checked)
+          bool uniform = y<num_y && framebuf_flash_counter==0 && row_uniform[row] && !at_cursor && !framebuf_is_row_dirty(FRAMEBUF_DIRTY_VIDEO, row);
+          uint n_pix   = uniform ? ((rowattr[row] & ROW_ATTR_DBL_WIDTH) ? 128 : 64) : FRAME_WIDTH;
+          for(int plane = 0; plane < 3; ++plane) 
             {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(y % char_height) * 256 * 8]);
+              uint32_t *planebuf = tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD);
+              const uint32_t *colors;
+              if( y>=num_y || framebuf_flash_counter!=0 )
+                colors = solidcolor;
+              else if( at_cursor )
+                colors = &cursorcolor[plane * color_plane_words_per_row];
+              else
+                colors = &rendercolor[prow * color_plane_words_per_row + plane * color_plane_size_words];
+
+              tmds_encode_font_2bpp(at_cursor ? cursorchars : (const uint16_t*)&showchars[prow * MAX_COLS],
+                                    colors,
+                                    planebuf,
+                                    n_pix,
+                                    font_line);
+              if( uniform ) tmds_repeat_char(planebuf, FRAME_WIDTH / DVI_SYMBOLS_PER_WORD);
             }
           
+          PROFILE_END(PROF_DVI_LINE, profile_start);
           queue_add_blocking(&dvi0.q_tmds_valid, &tmdsbuf);
         }
     }
 }
 
 
+void framebuf_dvi_set_page(uint8_t *databuf, uint8_t *ra)
+{
+  charbuf  = (uint16_t *) databuf;
+  colorbuf = (uint32_t *) (databuf + 60 * 80 * 2);
+}
+
+
+void framebuf_dvi_show_page(uint8_t *databuf, uint8_t *ra)
+{
+  // core1 uses the new buffers from the next row it renders on,
+  // framebuf.c marks all rows as changed so their colors get re-computed
+  showchars  = (uint16_t *) databuf;
+  showcolors = (uint32_t *) (databuf + 60 * 80 * 2);
+  rowattr    = ra;
+  rowmap     = ra + FRAMEBUF_ROWMAP_OFFSET;
+}
+
+
 void framebuf_dvi_init(uint8_t *databuf, uint8_t *ra)
 {
   vreg_set_voltage(VREG_VOLTAGE_1_20);
@@ -273,9 +497,8 @@ void framebuf_dvi_init(uint8_t *databuf, uint8_t *ra)
   // Run system at TMDS bit clock
   set_sys_clock_khz(DVI_TIMING.bit_clk_khz, true);
 
-  charbuf  = (uint16_t *) databuf;
-  colorbuf = (uint32_t *) (databuf + 60 * 80 * 2);
-  rowattr  = ra;
+  framebuf_dvi_set_page(databuf, ra);
+  framebuf_dvi_show_page(databuf, ra);
 
   dvi0.timing  = &DVI_TIMING;
   dvi0.ser_cfg = DVI_DEFAULT_SERIAL_CONFIG;
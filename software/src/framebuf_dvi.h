@@ -21,9 +21,13 @@
 #define FRAMEBUF_DVI_H
 
 void framebuf_dvi_init(uint8_t *databuf, uint8_t *rowattr);
+void framebuf_dvi_set_page(uint8_t *databuf, uint8_t *rowattr);
+void framebuf_dvi_show_page(uint8_t *databuf, uint8_t *rowattr);
 
 void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
 void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n);
+void framebuf_dvi_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
+void framebuf_dvi_charmemget(uint32_t idx, uint32_t *buf, size_t n);
 
 uint8_t framebuf_dvi_get_char(uint32_t idx);
 void    framebuf_dvi_set_char(uint32_t idx, uint8_t c);
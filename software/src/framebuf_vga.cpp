@@ -28,17 +28,67 @@ extern "C"
 }
 
 
-static uint8_t *charbuf = NULL;
+static uint8_t *charbuf = NULL;  // page modified by the frame buffer operations
 static sSegm*   textSeg = NULL;
 
+// page shown on screen and its row attributes (followed by the row map),
+// passed to the renderer in textSeg->data/par2 with the next frame
+static uint8_t * volatile showbuf = NULL;
+static uint8_t * volatile showrowattr = NULL;
+
+// the renderer (vga_ctext.S) shows the stored colors as they are, so bold and
+// inverse are applied to the colors when a cell is written and undone when it
+// is read: ATTR_INVERSE in the stored attribute means that foreground and
+// background are swapped (while the screen is inverted that bit is stored
+// flipped in the shown page, attr_xor is applied by operations on that page)
+// and ATTR_FG_BOLD means that the foreground is stored as its bold color
+#define ATTR_FG_BOLD 0x80
+static uint8_t  inverted = 0, attr_xor = 0;
+
 // defined in framebuf.c
 extern int16_t framebuf_flash_counter;
 extern uint8_t framebuf_flash_color;
+extern uint8_t framebuf_bold_color[256], framebuf_bold_color_inv[256];
+extern volatile uint32_t framebuf_cursor;
+
+// pairs of (text row containing the cursor, copy of the row with the cursor
+// drawn in it), the renderer (vga_ctext.S) displays the copy instead of the row
+extern "C" { uint32_t *RenderCTextCursor[4] = {NULL, NULL, NULL, NULL}; }
+static uint32_t cursorbuf[2][MAX_COLS];
+
+
+static inline uint32_t swap_colors(uint32_t w)
+{
+  return (w & 0xFFFF) | ((w & 0xFF0000) << 8) | ((w >> 8) & 0xFF0000);
+}
+
+
+static uint32_t encode_cell(uint32_t w)
+{
+  // cell (character, attribute, background, foreground) => cell as stored
+  uint32_t fg = w >> 24;
+  if( (w & (ATTR_BOLD << 8)) && framebuf_bold_color[fg]!=fg )
+    w = (w & 0x00FFFFFF) | ((uint32_t) framebuf_bold_color[fg] << 24) | (ATTR_FG_BOLD << 8);
+
+  w ^= attr_xor << 8;
+  return (w & (ATTR_INVERSE << 8)) ? swap_colors(w) : w;
+}
+
+
+static uint32_t decode_cell(uint32_t w)
+{
+  // cell as stored => cell (character, attribute, background, foreground)
+  if( w & (ATTR_INVERSE << 8) ) w = swap_colors(w);
+  if( w & (ATTR_FG_BOLD << 8) )
+    w = (w & 0x00FFFFFF & ~(ATTR_FG_BOLD << 8)) | ((uint32_t) framebuf_bold_color_inv[w >> 24] << 24);
+
+  return w ^ (attr_xor << 8);
+}
 
 
 void framebuf_vga_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
 {
-  uint32_t w = c + (a<<8) + (bg << 16) + (fg << 24);
+  uint32_t w = encode_cell(c + (a<<8) + (bg << 16) + (fg << 24));
   uint32_t *buf = (uint32_t *) (charbuf + idx*4);
   for(size_t i=0; i<n; i++) buf[i] = w;
 }
@@ -50,6 +100,21 @@ void framebuf_vga_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
 }
 
 
+void framebuf_vga_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint32_t w = encode_cell((a<<8) + (bg << 16) + (fg << 24));
+  uint32_t *buf = (uint32_t *) (charbuf + idx*4);
+  for(size_t i=0; i<n; i++) buf[i] = w | chars[i];
+}
+
+
+void framebuf_vga_charmemget(uint32_t idx, uint32_t *buf, size_t n)
+{
+  const uint32_t *src = (const uint32_t *) (charbuf + idx*4);
+  for(size_t i=0; i<n; i++) buf[i] = decode_cell(src[i]);
+}
+
+
 void framebuf_vga_set_char(uint32_t idx, uint8_t c)
 {
   charbuf[idx*4] = c;
@@ -64,63 +129,84 @@ uint8_t framebuf_vga_get_char(uint32_t idx)
 
 void framebuf_vga_set_attr(uint32_t idx, uint8_t a)
 {
-  charbuf[idx*4+1] = a;
+  uint32_t *cell = ((uint32_t *) charbuf) + idx;
+  *cell = encode_cell((decode_cell(*cell) & 0xFFFF00FF) | (a << 8));
 }
 
 
 uint8_t framebuf_vga_get_attr(uint32_t idx)
 {
-  return charbuf[idx*4 + 1];
+  return (charbuf[idx*4 + 1] ^ attr_xor) & ~ATTR_FG_BOLD;
 }
 
 
 void framebuf_vga_invert()
 {
-  uint32_t s = MAX_COLS*MAX_ROWS*4;
-  for(uint32_t i=0; i<s; i+=4)
-    {
-      uint8_t c    = charbuf[i+2];
-      charbuf[i+2] = charbuf[i+3];
-      charbuf[i+3] = c;
-    }
+  uint32_t *buf = (uint32_t *) showbuf;
+  for(uint32_t i=0; i<MAX_COLS*MAX_ROWS; i++) buf[i] = swap_colors(buf[i] ^ (ATTR_INVERSE << 8));
+  inverted ^= ATTR_INVERSE;
+  attr_xor = charbuf==showbuf ? inverted : 0;
 }
 
 
 void framebuf_vga_set_color(uint32_t idx, uint8_t fg, uint8_t bg)
 {
-  charbuf[idx*4 + 2] = bg;
-  charbuf[idx*4 + 3] = fg;
+  uint32_t *cell = ((uint32_t *) charbuf) + idx;
+  *cell = encode_cell((decode_cell(*cell) & 0xFFFF) | (bg << 16) | (fg << 24));
 }
 
 
 void framebuf_vga_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg)
 {
-  *bg = charbuf[idx*4 + 2];
-  *fg = charbuf[idx*4 + 3];
+  uint32_t w = decode_cell(((uint32_t *) charbuf)[idx]);
+  *bg = (w >> 16) & 0xFF;
+  *fg = w >> 24;
 }
 
 
 void framebuf_vga_set_char_and_attr(uint32_t idx, uint32_t c)
 {
-  ((uint32_t *) charbuf)[idx] = c;
+  ((uint32_t *) charbuf)[idx] = encode_cell(c);
 }
 
 
 uint32_t framebuf_vga_get_char_and_attr(uint32_t idx)
 {
-  return ((uint32_t *) charbuf)[idx];
+  return decode_cell(((uint32_t *) charbuf)[idx]);
+}
+
+
+static void framebuf_vga_update_cursor()
+{
+  uint32_t cursor = framebuf_cursor;
+  uint8_t  attr   = cursor >> 24;
+  uint     col    = cursor & 0xFF;
+  uint     row    = (cursor >> 8) & 0xFF;
+  uint     n      = attr ? ((cursor >> 16) & 0xFF) : 0;
+
+  for(uint i=0; i<2; i++)
+    if( i<n )
+      {
+        uint32_t *src = ((uint32_t *) showbuf) + showrowattr[FRAMEBUF_ROWMAP_OFFSET+row+i] * MAX_COLS;
+        memcpy(cursorbuf[i], src, MAX_COLS * 4);
+        cursorbuf[i][col] ^= attr << 8;
+        if( attr & ATTR_INVERSE ) cursorbuf[i][col] = swap_colors(cursorbuf[i][col]);
+        RenderCTextCursor[i*2+1] = cursorbuf[i];
+        RenderCTextCursor[i*2]   = src;
+      }
+    else
+      RenderCTextCursor[i*2] = NULL;
 }
 
 
 static void framebuf_vga_new_frame()
 {
-  static uint32_t par, par2;
+  static uint32_t par;
   static int frameCtr = 0;
 
   if( framebuf_flash_counter<0 )
     {
       par  = textSeg->par;
-      par2 = textSeg->par2;
       textSeg->form = GF_COLOR;
       textSeg->par  = framebuf_flash_color | (framebuf_flash_color<<8) | (framebuf_flash_color<<16) | (framebuf_flash_color<<24);
       textSeg->par2 = framebuf_flash_color | (framebuf_flash_color<<8) | (framebuf_flash_color<<16) | (framebuf_flash_color<<24);
@@ -132,7 +218,6 @@ static void framebuf_vga_new_frame()
         {          
           textSeg->form = GF_CTEXT;
           textSeg->par  = par;
-          textSeg->par2 = par2;
         }
     }
   else if( ++frameCtr>=config_get_screen_blink_period()/2 )
@@ -145,13 +230,38 @@ static void framebuf_vga_new_frame()
       frameCtr = 0;
     }
   
+  // switch the renderer to the shown page (see framebuf_vga_show_page)
+  if( textSeg->form == GF_CTEXT )
+    {
+      textSeg->data = showbuf;
+      textSeg->par2 = (uint32_t) showrowattr;
+    }
+
   textSeg->par3 = font_get_char_height();
+  framebuf_vga_update_cursor();
+}
+
+
+void framebuf_vga_set_page(uint8_t *databuf, uint8_t *rowattr)
+{
+  charbuf  = databuf;
+  attr_xor = charbuf==showbuf ? inverted : 0;
+}
+
+
+void framebuf_vga_show_page(uint8_t *databuf, uint8_t *rowattr)
+{
+  // the renderer switches to the new page at the start of the next frame
+  showbuf     = databuf;
+  showrowattr = rowattr;
+  attr_xor    = charbuf==showbuf ? inverted : 0;
 }
 
 
 void framebuf_vga_init(uint8_t *databuf, uint8_t *rowattr)
 {
-  charbuf = databuf;
+  framebuf_vga_set_page(databuf, rowattr);
+  framebuf_vga_show_page(databuf, rowattr);
   
   // run VGA core
   multicore_launch_core1(VgaCore);
@@ -168,7 +278,7 @@ void framebuf_vga_init(uint8_t *databuf, uint8_t *rowattr)
   sStrip* t = ScreenAddStrip(pScreen, FRAME_HEIGHT);
   textSeg = ScreenAddSegm(t, FRAME_WIDTH);
   ScreenSegmCText(textSeg, charbuf, font_get_data_blinkon(), font_get_char_height(), MAX_COLS*4);
-  textSeg->par2 = (uint32_t) rowattr;
+  textSeg->par2 = (uint32_t) rowattr; // row attributes, followed by row map
   VgaSetNewFrameCallback(framebuf_vga_new_frame);
   
   // initialize system clock
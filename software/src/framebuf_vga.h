@@ -25,9 +25,13 @@ extern "C" {
 #endif
 
 void framebuf_vga_init(uint8_t *databuf, uint8_t *rowattr);
+void framebuf_vga_set_page(uint8_t *databuf, uint8_t *rowattr);
+void framebuf_vga_show_page(uint8_t *databuf, uint8_t *rowattr);
 
 void framebuf_vga_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
 void framebuf_vga_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n);
+void framebuf_vga_charmemcpy(uint32_t idx, const uint8_t *chars, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
+void framebuf_vga_charmemget(uint32_t idx, uint32_t *buf, size_t n);
 
 uint8_t framebuf_vga_get_char(uint32_t idx);
 void    framebuf_vga_set_char(uint32_t idx, uint8_t c);
@@ -31,6 +31,8 @@
 #include "font.h"
 #include "pins.h"
 #include "sound.h"
+#include "stats.h"
+#include "profile.h"
 
 
 // see comment at start of main()
@@ -55,12 +57,16 @@ void wait(uint32_t milliseconds);
 
 void run_tasks(bool processInput)
 {
+  static uint32_t calls = 0;
+  uint32_t call = ++calls;
+  uint32_t start_time = time_us_32();
+
   // tinyusb tasks
-  if( tud_inited() ) tud_task();
-  if( tuh_inited() ) tuh_task();
+  if( tud_inited() ) PROFILE(PROF_TUD_TASK, tud_task());
+  if( tuh_inited() ) PROFILE(PROF_TUH_TASK, tuh_task());
   
   // process serial input
-  serial_task(processInput);
+  PROFILE(PROF_SERIAL_TASK, serial_task(processInput));
 
   // handle bootsel mechanism timeout
   if( bootsel_timeout>0 && get_absolute_time()>=bootsel_timeout )
@@ -71,7 +77,7 @@ void run_tasks(bool processInput)
     }
   
   // process keyboard input
-  keyboard_task();
+  PROFILE(PROF_KEYBOARD_TASK, keyboard_task());
   if( processInput && keyboard_num_keypress()>0 )
     {
       uint16_t key = keyboard_read_keypress();
@@ -89,6 +95,13 @@ void run_tasks(bool processInput)
             }
           else if( key==HID_KEY_F11 )
             keyboard_macro_record_startstop();
+          else if( keyboard_alt_pressed(key) && (key&0xFF)>=HID_KEY_F1 && (key&0xFF)<HID_KEY_F1+TERMINAL_NUM_CONSOLES && config_get_usb_cdcmode()==4 )
+            terminal_show_console((key&0xFF)-HID_KEY_F1);
+          else if( keyboard_shift_pressed(key) && (key&0xFF)==HID_KEY_PAGE_UP && terminal_get_visible_console()==TERMINAL_CONSOLE_MAIN )
+            {
+              key = framebuf_scrollback_view(key);
+              if( key!=HID_KEY_NONE ) terminal_process_key(key);
+            }
           else if( keyboard_ctrl_pressed(key) && (key&0xFF)>=HID_KEY_F1 && (key&0xFF)<=HID_KEY_F10 )
             {
               uint8_t vol = config_get_audible_bell_volume();
@@ -108,6 +121,12 @@ void run_tasks(bool processInput)
             terminal_process_key(key);
         }
     }
+
+  // send output collected during this iteration
+  serial_flush();
+
+  // iterations that ran nested loops (e.g. the configuration menu) are not counted
+  if( calls==call ) stats_loop_time(time_us_32()-start_time);
 }
 
 
@@ -144,6 +163,9 @@ int main()
       reset_usb_boot(1<<25, 0);
     }
   
+#ifdef VERSATERM_PROFILE
+  profile_init_core();
+#endif
   config_init();
   stdio_uart_init_full(PIN_UART_ID, 300, PIN_UART_TX, PIN_UART_RX);
   serial_init();
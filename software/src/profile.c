@@ -0,0 +1,94 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include "profile.h"
+
+#ifdef VERSATERM_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/regs/m0plus.h"
+
+struct profile_region
+{
+  uint32_t count, max;
+  uint64_t total;
+  uint32_t hist[PROFILE_BUCKETS]; // hist[i]: number of runs taking 2^i..2^(i+1)-1 cycles
+};
+
+static const char *region_names[PROF_NUM_REGIONS] =
+  {"terminal_receive", "print_char_vt", "print_run_vt", "scroll_region",
+   "serial_task", "tud_task", "tuh_task", "keyboard_task", "dvi_line", "dvi_rows"};
+
+// each region is only updated from one core
+static struct profile_region regions[PROF_NUM_REGIONS];
+
+
+void profile_init_core()
+{
+  // let SysTick of the calling core count down CPU cycles continuously
+  systick_hw->csr = 0;
+  systick_hw->rvr = 0x00FFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+
+void __not_in_flash_func(profile_add)(uint8_t region, uint32_t start)
+{
+  uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+  struct profile_region *r = &regions[region];
+  r->count++;
+  r->total += cycles;
+  if( cycles>r->max ) r->max = cycles;
+  r->hist[cycles==0 ? 0 : 31-__builtin_clz(cycles)]++;
+}
+
+
+void profile_reset()
+{
+  memset(regions, 0, sizeof(regions));
+}
+
+
+void profile_report(void (*out)(const char *line))
+{
+  char line[81];
+
+  snprintf(line, sizeof(line), "%-16s %9s %10s %10s  %s", "region", "count", "avg cyc", "max cyc", "histogram (log2 cycles:%)");
+  out(line);
+  for(int i=0; i<PROF_NUM_REGIONS; i++)
+    {
+      const struct profile_region *r = &regions[i];
+      int n = snprintf(line, sizeof(line), "%-16s %9lu %10lu %10lu ", region_names[i], 
+                       (unsigned long) r->count, (unsigned long) (r->count>0 ? r->total/r->count : 0), (unsigned long) r->max);
+
+      // show the buckets holding at least 1% of the runs
+      for(int b=0; b<PROFILE_BUCKETS && n<(int) sizeof(line)-8; b++)
+        {
+          uint32_t pct = r->count>0 ? (uint32_t) ((uint64_t) r->hist[b]*100 / r->count) : 0;
+          if( pct>0 ) n += snprintf(line+n, sizeof(line)-n, " %i:%lu", b, (unsigned long) pct);
+        }
+
+      out(line);
+    }
+}
+
+#endif
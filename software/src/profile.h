@@ -0,0 +1,73 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// Optional profiling of hot code paths, enabled by building with
+// VERSATERM_PROFILE defined (cmake -DVERSATERM_PROFILE=ON). Regions are
+// timed in CPU cycles using the SysTick timer of the core they run on
+// (24 bits, so regions must be shorter than 2^24 cycles) and collected
+// in histograms with power-of-two buckets. Results are shown in the
+// configuration menu, from where they can also be sent over USB CDC.
+
+#define PROF_TERMINAL_RECEIVE  0
+#define PROF_PRINT_CHAR        1
+#define PROF_PRINT_RUN         2
+#define PROF_SCROLL_REGION     3
+#define PROF_SERIAL_TASK       4
+#define PROF_TUD_TASK          5
+#define PROF_TUH_TASK          6
+#define PROF_KEYBOARD_TASK     7
+#define PROF_DVI_LINE          8
+#define PROF_DVI_ROWS          9
+#define PROF_NUM_REGIONS      10
+
+#define PROFILE_BUCKETS       24
+
+#ifdef VERSATERM_PROFILE
+
+#include "hardware/structs/systick.h"
+
+// time a region within a function
+#define PROFILE_BEGIN(var)         uint32_t var = systick_hw->cvr
+#define PROFILE_END(region, var)   profile_add(region, var)
+
+// time a single statement
+#define PROFILE(region, stmt) \
+  do { uint32_t profile_start_ = systick_hw->cvr; stmt; profile_add(region, profile_start_); } while( 0 )
+
+void profile_init_core();
+void profile_add(uint8_t region, uint32_t start);
+void profile_reset();
+
+// call "out" for each line of the results report
+void profile_report(void (*out)(const char *line));
+
+#else
+
+#define PROFILE_BEGIN(var)
+#define PROFILE_END(region, var)
+#define PROFILE(region, stmt) stmt
+
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+
+#include <string.h>
+#include "scrollback.h"
+
+// Scrollback lines are kept in a byte ring buffer. Each line is stored as
+//   [number of cells] [row attributes] run run ...
+// where each run is
+//   [n] [attr] [bg] [fg] followed by n characters
+// Trailing blanks of the last run are not stored, they are re-created
+// from the line's cell count when decoding.
+// The start of each line within the ring buffer is kept in a separate
+// index ring. Positions are free-running 16-bit values (the buffer size
+// divides 65536) so the difference of two positions is always the number
+// of bytes between them.
+// New lines are written linearly (the buffer has room for one line past
+// its end) and the part that went past the end is then copied to the start.
+
+#define SCROLLBACK_SIZE      32768  // must be a power of two <= 32768
+#define SCROLLBACK_LINES     1024   // must be a power of two
+#define SCROLLBACK_LINE_MAX  (2+80*5)
+
+static uint8_t  sb_data[SCROLLBACK_SIZE+SCROLLBACK_LINE_MAX];
+static uint16_t sb_start[SCROLLBACK_LINES];
+static uint16_t sb_first = 0, sb_num = 0, sb_head = 0;
+
+#define SB_BYTE(pos)  sb_data[(uint16_t) (pos) & (SCROLLBACK_SIZE-1)]
+#define SB_LINE(i)    sb_start[(sb_first+(i)) & (SCROLLBACK_LINES-1)]
+
+
+void scrollback_clear()
+{
+  sb_first = 0;
+  sb_num   = 0;
+  sb_head  = 0;
+}
+
+
+uint16_t scrollback_num_lines()
+{
+  return sb_num;
+}
+
+
+void scrollback_add_line(uint8_t rowattr, const uint32_t *cells, uint8_t n)
+{
+  // drop oldest lines until a worst-case line fits
+  while( sb_num>0 && (sb_num==SCROLLBACK_LINES || (uint16_t) (sb_head-SB_LINE(0)) > SCROLLBACK_SIZE-SCROLLBACK_LINE_MAX) )
+    { sb_first = (sb_first+1) & (SCROLLBACK_LINES-1); sb_num--; }
+
+  SB_LINE(sb_num) = sb_head;
+  sb_num++;
+
+  uint8_t *start = &SB_BYTE(sb_head), *p = start;
+  *p++ = n;
+  *p++ = rowattr;
+
+  uint8_t i = 0;
+  while( i<n )
+    {
+      // find the end of the run of cells with identical attributes and colors
+      uint32_t a = cells[i] & 0xFFFFFF00;
+      uint8_t  j = i+1;
+      while( j<n && (cells[j] & 0xFFFFFF00)==a ) j++;
+
+      // the last run does not need to store trailing blanks
+      uint8_t e = j;
+      if( j==n ) while( e>i && (cells[e-1] & 0xFF)==' ' ) e--;
+
+      *p++ = e-i;
+      *p++ = a >> 8;
+      *p++ = a >> 16;
+      *p++ = a >> 24;
+      while( i<e ) *p++ = cells[i++];
+      i = j;
+    }
+
+  if( p > sb_data+SCROLLBACK_SIZE )
+    memcpy(sb_data, sb_data+SCROLLBACK_SIZE, p-(sb_data+SCROLLBACK_SIZE));
+
+  sb_head += p-start;
+}
+
+
+void scrollback_remove_lines(uint16_t n)
+{
+  if( n>=sb_num )
+    scrollback_clear();
+  else
+    {
+      sb_num -= n;
+      sb_head = SB_LINE(sb_num);
+    }
+}
+
+
+uint8_t scrollback_get_line(uint16_t i, uint32_t *cells, uint8_t maxcells, uint8_t *rowattr)
+{
+  uint8_t  n = 0, col = 0;
+  uint32_t a = 0;
+
+  if( i<sb_num )
+    {
+      uint16_t pos = SB_LINE(i);
+      uint16_t end = i+1<sb_num ? SB_LINE(i+1) : sb_head;
+
+      n = SB_BYTE(pos++);
+      *rowattr = SB_BYTE(pos++);
+      while( pos!=end )
+        {
+          uint8_t cnt = SB_BYTE(pos++);
+          a  = SB_BYTE(pos++) << 8;
+          a |= SB_BYTE(pos++) << 16;
+          a |= (uint32_t) SB_BYTE(pos++) << 24;
+          for(uint8_t k=0; k<cnt; k++, pos++)
+            if( col<maxcells ) cells[col++] = a | SB_BYTE(pos);
+        }
+    }
+  else
+    *rowattr = 0;
+
+  while( col<maxcells ) cells[col++] = a | ' ';
+  return n;
+}
@@ -0,0 +1,39 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include "pico/stdlib.h"
+
+// Lines are passed in and out as arrays of cells in the same format as
+// returned by framebuf_*_get_char_and_attr(): char | attr<<8 | bg<<16 | fg<<24
+
+void     scrollback_clear();
+void     scrollback_add_line(uint8_t rowattr, const uint32_t *cells, uint8_t n);
+void     scrollback_remove_lines(uint16_t n);
+uint16_t scrollback_num_lines();
+
+// decode line i (0=oldest) into cells[0..maxcells-1], cells beyond the end of
+// the stored line are filled with blanks in the colors of the last stored cell
+// returns the number of cells the line was stored with
+uint8_t  scrollback_get_line(uint16_t i, uint32_t *cells, uint8_t maxcells, uint8_t *rowattr);
+
+#endif
@@ -17,6 +17,7 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
 // -----------------------------------------------------------------------------
 
+#include "pico/stdlib.h"
 #include "pins.h"
 #include "serial.h"
 #include "serial_uart.h"
@@ -56,8 +57,24 @@ bool serial_readable()
 
 void serial_task(bool processInput)
 {
-  serial_uart_task(processInput);
-  serial_cdc_task(processInput);
+  // keep processing input as long as there is some available, up to
+  // the time and byte budget (the USB and keyboard tasks run in between)
+  absolute_time_t endtime = make_timeout_time_us(SERIAL_TASK_MAX_US);
+  size_t total = 0, n;
+  do
+    {
+      n  = serial_uart_task(processInput);
+      n += serial_cdc_task(processInput);
+      total += n;
+    }
+  while( n>0 && total<SERIAL_TASK_MAX_BYTES && !time_reached(endtime) );
+}
+
+
+void serial_flush()
+{
+  // send any output that is still buffered
+  serial_cdc_flush();
 }
 
 
@@ -100,7 +117,8 @@ int __in_flash(".configfun")  serial_xmodem_receive_char(int msDelay)
         }
       else
         {
-          if( uart_is_readable(PIN_UART_ID) ) return uart_getc(PIN_UART_ID);
+          uint8_t b;
+          if( serial_uart_receive_char_raw(&b) ) return b;
         }
     }
   
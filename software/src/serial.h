@@ -22,6 +22,16 @@
 
 #include <stdbool.h>
 
+// maximum time (microseconds) and number of bytes serial_task() spends on
+// received data before returning to the main loop (USB and keyboard tasks)
+#ifndef SERIAL_TASK_MAX_US
+#define SERIAL_TASK_MAX_US    2000
+#endif
+
+#ifndef SERIAL_TASK_MAX_BYTES
+#define SERIAL_TASK_MAX_BYTES 2048
+#endif
+
 void serial_set_break(bool set);
 void serial_send_char(char c);
 void serial_send_string(const char *s);
@@ -31,6 +41,7 @@ int  serial_xmodem_receive_char(int msDelay);
 void serial_xmodem_send_data(const char *data, int size);
 
 void serial_task(bool processInput);
+void serial_flush();
 void serial_apply_settings();
 void serial_init();
 
@@ -0,0 +1,83 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Moves data between USB CDC and the UART in USB pass-through mode.
+//
+// CDC->UART: data read from CDC is collected in one buffer while the other
+// one is being sent to the UART by DMA. The UART holds back transmission
+// while CTS is not asserted or after receiving XOFF (transmitter disabled),
+// which stalls the DMA transfer and in turn reading from CDC, so USB
+// flow-controls the host.
+//
+// UART->CDC: data is taken from the UART receive ring buffer (filled by
+// DMA) in blocks as large as the CDC transmit FIFO has room for. If USB does
+// not keep up, the ring buffer fills up and the UART sends XOFF.
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "serial_bridge.h"
+#include "serial_uart.h"
+#include "serial_cdc.h"
+#include "terminal.h"
+
+#define BRIDGE_BUF_SIZE 1024
+
+static uint8_t tx_buf[2][BRIDGE_BUF_SIZE];
+static size_t  tx_len  = 0; // number of bytes in tx_buf[tx_fill]
+static uint8_t tx_fill = 0; // buffer currently being filled from CDC
+
+
+size_t serial_bridge_cdc_to_uart()
+{
+  size_t n = 0;
+  if( tx_len<BRIDGE_BUF_SIZE && tud_cdc_available() )
+    {
+      n = tud_cdc_read(tx_buf[tx_fill]+tx_len, BRIDGE_BUF_SIZE-tx_len);
+      tx_len += n;
+    }
+
+  // swap buffers as soon as the previous one has been sent
+  if( tx_len>0 && !serial_uart_send_dma_busy() )
+    {
+      serial_uart_send_dma(tx_buf[tx_fill], tx_len);
+      tx_fill = 1-tx_fill;
+      tx_len  = 0;
+    }
+
+  return n;
+}
+
+
+size_t serial_bridge_uart_to_cdc(bool showOnTerminal)
+{
+  uint8_t buf[256];
+  size_t n = sizeof(buf);
+
+  // if CDC is not connected then received data is dropped (or only displayed)
+  if( serial_cdc_is_connected() ) n = MIN(n, tud_cdc_write_available());
+
+  n = serial_uart_receive(buf, n);
+  if( n>0 )
+    {
+      if( showOnTerminal ) terminal_receive_buffer(buf, n);
+      serial_cdc_send_buffer((const char *) buf, n);
+    }
+
+  return n;
+}
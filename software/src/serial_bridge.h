@@ -0,0 +1,31 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef SERIAL_BRIDGE_H
+#define SERIAL_BRIDGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// USB pass-through mode (cdcmode 2/3): move data between USB CDC and the
+// UART, both return the number of bytes moved
+size_t serial_bridge_cdc_to_uart();
+size_t serial_bridge_uart_to_cdc(bool showOnTerminal);
+
+#endif
@@ -22,8 +22,18 @@
 #include "terminal.h"
 #include "serial_cdc.h"
 #include "serial_uart.h"
+#include "serial_bridge.h"
+#include "stats.h"
 #include "framebuf.h"
 
+// output is collected in the CDC FIFO and sent when the FIFO is full, when
+// serial_cdc_flush() is called at the end of a main loop iteration or at
+// the latest this many microseconds after it was written
+#define CDC_FLUSH_TIMEOUT_US 1000
+
+// time at which buffered output must be sent (0 if there is none)
+static absolute_time_t flushtime = 0;
+
 
 static void terminal_disabled_message(bool show)
 {
@@ -58,22 +68,49 @@ void serial_cdc_set_break(bool set)
 }
 
 
-void serial_cdc_send_char(char c)
+static void flush_now()
+{
+  flushtime = 0;
+  tud_cdc_write_flush();
+}
+
+
+size_t serial_cdc_send_buffer(const char *buf, size_t n)
 {
+  // returns the number of bytes accepted, which may be less than n if
+  // the CDC FIFO (64 bytes) is full
+  size_t written = 0;
   if( tud_cdc_connected() )
     {
-      tud_cdc_write(&c, 1);
-      tud_cdc_write_flush();
+      written = tud_cdc_write(buf, n);
+      if( tud_cdc_write_available()==0 )
+        flush_now();
+      else if( flushtime==0 )
+        flushtime = make_timeout_time_us(CDC_FLUSH_TIMEOUT_US);
     }
+
+  return written;
+}
+
+
+void serial_cdc_send_char(char c)
+{
+  serial_cdc_send_buffer(&c, 1);
 }
 
 
 void serial_cdc_send_string(const char *s)
 {
-  if( tud_cdc_connected() )
+  serial_cdc_send_buffer(s, strlen(s));
+}
+
+
+void serial_cdc_flush()
+{
+  if( flushtime!=0 )
     {
-      tud_cdc_write(s, strlen(s));
-      tud_cdc_write_flush();
+      flushtime = 0;
+      if( tud_cdc_connected() ) tud_cdc_write_flush();
     }
 }
 
@@ -84,11 +121,16 @@ bool serial_cdc_readable()
 }
 
 
-void serial_cdc_task(bool processInput)
+size_t serial_cdc_task(bool processInput)
 {
-  if( processInput && tud_inited() && tud_cdc_available() )
+  size_t count = 0;
+
+  if( flushtime!=0 && time_reached(flushtime) )
+    serial_cdc_flush();
+
+  if( processInput && tud_inited() )
     {
-      char count, buf[16];
+      char buf[64];
 
       switch( config_get_usb_cdcmode() )
         {
@@ -96,21 +138,24 @@ void serial_cdc_task(bool processInput)
           break;
 
         case 1: // regular serial
-          count = tud_cdc_read(buf, sizeof(buf));
-          for(int i=0; i<count; i++) terminal_receive_char(buf[i]);
+        case 4: // separate console
+          if( tud_cdc_available() )
+            {
+              count = tud_cdc_read(buf, sizeof(buf));
+              terminal_console_receive_buffer(config_get_usb_cdcmode()==4 ? TERMINAL_CONSOLE_USB : TERMINAL_CONSOLE_MAIN, 
+                                              (const uint8_t *) buf, count);
+            }
           break;
 
         case 2: // pass-through
         case 3: // pass-through (terminal disabled)
-          {
-            count = MIN(serial_uart_can_send(), sizeof(buf));
-            if( count>0 ) count = tud_cdc_read(buf, count);
-            for(int i=0; i<count; i++) serial_uart_send_char(buf[i]);
-
-            break;
-          }
+          count = serial_bridge_cdc_to_uart();
+          break;
         }
     }
+
+  stats.rx_cdc += count;
+  return count;
 }
 
 
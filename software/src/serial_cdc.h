@@ -21,14 +21,17 @@
 #define SERIAL_CDC_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 bool serial_cdc_is_connected();
 void serial_cdc_set_break(bool set);
 void serial_cdc_send_char(char c);
 void serial_cdc_send_string(const char *c);
+size_t serial_cdc_send_buffer(const char *buf, size_t n);
+void serial_cdc_flush();
 bool serial_cdc_readable();
 
-void serial_cdc_task(bool processInput);
+size_t serial_cdc_task(bool processInput);
 void serial_cdc_apply_settings();
 void serial_cdc_init();
 
@@ -0,0 +1,70 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include "serial_ring.h"
+
+
+void serial_ring_init(struct serial_ring *r, const volatile uint8_t *buf, uint32_t size, uint32_t head)
+{
+  r->buf  = buf;
+  r->size = size;
+  r->tail = head;
+  r->overflows = 0;
+  r->lost = 0;
+}
+
+
+uint32_t serial_ring_level(struct serial_ring *r, uint32_t head)
+{
+  uint32_t level = head - r->tail;
+  if( level > r->size )
+    {
+      // the producer has overwritten data that was not read yet: skip ahead
+      // and only keep the newest half of the buffer, so the data we read
+      // next is not overwritten again while we are reading it
+      uint32_t keep = r->size / 2;
+      r->overflows++;
+      r->lost += level - keep;
+      r->tail  = head - keep;
+      level    = keep;
+    }
+
+  return level;
+}
+
+
+uint8_t serial_ring_peek(const struct serial_ring *r, uint32_t pos)
+{
+  return r->buf[pos & (r->size-1)];
+}
+
+
+size_t serial_ring_read(struct serial_ring *r, uint32_t head, uint8_t *dst, size_t n)
+{
+  uint32_t level = serial_ring_level(r, head);
+  if( n > level ) n = level;
+
+  uint32_t mask = r->size-1;
+  uint32_t tail = r->tail;
+  for(size_t i=0; i<n; i++)
+    dst[i] = r->buf[(tail+i) & mask];
+
+  r->tail = tail + n;
+  return n;
+}
@@ -0,0 +1,52 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef SERIAL_RING_H
+#define SERIAL_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Consumer side of a receive ring buffer that is filled by a producer (the
+// UART RX DMA channel) which writes bytes round-robin into the buffer and
+// only reports the total number of bytes written so far ("head", counting
+// up and wrapping at 2^32). If the producer gets more than a buffer size
+// ahead of the consumer, the oldest data is skipped and counted as lost.
+
+struct serial_ring
+{
+  const volatile uint8_t *buf;  // ring buffer data (size must be a power of 2)
+  uint32_t size;
+  uint32_t tail;                // total number of bytes consumed (or skipped)
+  uint32_t overflows;           // number of times the producer overran the consumer
+  uint32_t lost;                // total number of bytes skipped due to overruns
+};
+
+void     serial_ring_init(struct serial_ring *r, const volatile uint8_t *buf, uint32_t size, uint32_t head);
+
+// number of bytes available for reading
+uint32_t serial_ring_level(struct serial_ring *r, uint32_t head);
+
+// byte at position "pos" (a total byte count between tail and head)
+uint8_t  serial_ring_peek(const struct serial_ring *r, uint32_t pos);
+
+// read up to n bytes into dst, returns the number of bytes read
+size_t   serial_ring_read(struct serial_ring *r, uint32_t head, uint8_t *dst, size_t n);
+
+#endif
@@ -17,13 +17,17 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
 // -----------------------------------------------------------------------------
 
+#include <string.h>
 #include "pico/stdlib.h"
-#include "pico/util/queue.h"
 #include "hardware/uart.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
 
 #include "serial_uart.h"
+#include "serial_ring.h"
 #include "serial_cdc.h"
+#include "serial_bridge.h"
+#include "stats.h"
 #include "config.h"
 #include "pins.h"
 #include "terminal.h"
@@ -32,11 +36,40 @@
 #define XON  17
 #define XOFF 19
 
-// extended TX FIFO (512 bytes) f that is not affected by disabling the UART fifos
-static queue_t uart_tx_queue;
-
-// RX FIFO used for Xon/Xoff flow control
-static queue_t uart_rx_queue;
+// extended TX FIFO (512 bytes) that is not affected by disabling the UART fifos
+// (only used from the main loop so it does not need locking)
+#define TX_QUEUE_SIZE 512
+static uint8_t  tx_queue[TX_QUEUE_SIZE];
+static uint32_t tx_queue_head = 0, tx_queue_tail = 0; // total number of bytes added/removed
+
+// receive ring buffer (size must be a power of 2, at most 32768), filled by DMA
+#define RX_RING_SIZE 8192
+static uint8_t rx_buf[RX_RING_SIZE] __attribute__((aligned(RX_RING_SIZE)));
+static struct serial_ring rx_ring;
+
+// PicoVGA uses fixed DMA channels starting at 0 and PicoDVI claims
+// unused channels, so use the last channels for receiving and sending
+#define RX_DMA_CHANNEL (NUM_DMA_CHANNELS-1)
+#define TX_DMA_CHANNEL (NUM_DMA_CHANNELS-2)
+
+// number of bytes received before the RX DMA channel was last (re-)started
+static uint32_t rx_dma_base = 0;
+
+// number of received bytes checked for XON/XOFF so far
+static uint32_t rx_scanned = 0;
+
+// receive flow control (XOFF sent and/or RTS de-asserted while stopped):
+// the sender is stopped when the backlog of unprocessed data in the receive
+// buffer exceeds the high watermark and resumed when it drops below the low
+// watermark. The watermarks leave room for the data that still arrives
+// during the round-trip latency after stopping, which is measured each time
+#define RX_DEFAULT_LATENCY_US 10000
+static bool     rx_stopped = false;
+static uint8_t  rx_flow_char = 0; // XON/XOFF waiting for room in the UART FIFO
+static uint32_t rx_high = RX_RING_SIZE*3/4, rx_low = RX_RING_SIZE/4;
+static uint32_t rx_latency_us = RX_DEFAULT_LATENCY_US;
+static uint32_t rx_last_head;
+static absolute_time_t rx_stop_time, rx_last_arrival;
 
 // timeout when to turn off blink LED
 static absolute_time_t offtime = 0;
@@ -60,57 +93,264 @@ void serial_uart_set_break(bool set)
 
 int serial_uart_can_send()
 {
-  return 512-queue_get_level(&uart_tx_queue);
+  return TX_QUEUE_SIZE-(tx_queue_head-tx_queue_tail);
+}
+
+
+static size_t tx_fill_fifo()
+{
+  // move queued data into the UART FIFO as far as it has room
+  size_t n = 0;
+  while( tx_queue_tail!=tx_queue_head && uart_is_writable(PIN_UART_ID) )
+    {
+      uart_get_hw(PIN_UART_ID)->dr = tx_queue[tx_queue_tail++ % TX_QUEUE_SIZE];
+      n++;
+    }
+
+  return n;
+}
+
+
+void serial_uart_send_buffer(const char *buf, size_t n)
+{
+  if( n==0 ) return;
+  blink_led(config_get_serial_blink());
+
+  // write directly into the UART FIFO while nothing is queued
+  while( n>0 && tx_queue_tail==tx_queue_head && uart_is_writable(PIN_UART_ID) )
+    { uart_get_hw(PIN_UART_ID)->dr = *buf++; n--; }
+
+  // queue the rest (as far as there is room), serial_uart_task() sends it
+  n = MIN(n, (size_t) serial_uart_can_send());
+  while( n>0 )
+    {
+      uint32_t i = tx_queue_head % TX_QUEUE_SIZE;
+      size_t   m = MIN(n, TX_QUEUE_SIZE-i);
+      memcpy(tx_queue+i, buf, m);
+      tx_queue_head += m;
+      buf += m;
+      n   -= m;
+    }
 }
 
 
 void serial_uart_send_char(char c)
 {
-  if( uart_is_writable(PIN_UART_ID) && queue_is_empty(&uart_tx_queue) )
+  serial_uart_send_buffer(&c, 1);
+}
+
+
+void serial_uart_send_string(const char *s)
+{
+  serial_uart_send_buffer(s, strlen(s));
+}
+
+
+static uint32_t rx_head()
+{
+  // total number of bytes received so far (the DMA channel counts down
+  // from 0xFFFFFFFF and stops at 0, in which case it gets restarted)
+  uint32_t n = 0xFFFFFFFF - dma_channel_hw_addr(RX_DMA_CHANNEL)->transfer_count;
+  if( n==0xFFFFFFFF && !dma_channel_is_busy(RX_DMA_CHANNEL) )
     {
-      blink_led(config_get_serial_blink());
-      uart_get_hw(PIN_UART_ID)->dr = c;
+      rx_dma_base += n;
+      dma_channel_set_trans_count(RX_DMA_CHANNEL, 0xFFFFFFFF, true);
+      n = 0;
     }
+
+  return rx_dma_base + n;
+}
+
+
+static void rx_set_watermarks()
+{
+  // data arrives at about baud/10 bytes per second (start, data and stop bits),
+  // plus the time for the UART FIFO (32 bytes) to make room for XOFF
+  uint32_t headroom = (uint32_t) ((uint64_t) config_get_serial_baud() * rx_latency_us / 10000000) + 64 + 32;
+  if( headroom > RX_RING_SIZE*3/4 ) headroom = RX_RING_SIZE*3/4;
+  rx_high = RX_RING_SIZE - headroom;
+  rx_low  = MIN(headroom, rx_high/2);
+}
+
+
+static void tx_dma_pause(bool pause)
+{
+  // a paused channel stays busy and continues where it stopped when resumed
+  if( pause )
+    hw_clear_bits(&dma_channel_hw_addr(TX_DMA_CHANNEL)->al1_ctrl, DMA_CH0_CTRL_TRIG_EN_BITS);
   else
-    queue_try_add(&uart_tx_queue, (uint8_t *) &c);
+    hw_set_bits(&dma_channel_hw_addr(TX_DMA_CHANNEL)->al1_ctrl, DMA_CH0_CTRL_TRIG_EN_BITS);
 }
 
 
-void serial_uart_send_string(const char *s)
+static void rx_send_flow_char(uint8_t c)
 {
-  while( *s ) serial_uart_send_char(*s++);
+  // if XON is still waiting to be sent then the sender has not been
+  // resumed yet, so there is no need for XOFF (and vice versa)
+  if( rx_flow_char==0 )
+    rx_flow_char = c;
+  else
+    {
+      rx_flow_char = 0;
+      tx_dma_pause(false);
+    }
 }
 
 
-bool serial_uart_receive_char(uint8_t *b)
+static void rx_flush_flow_char()
 {
-  bool res = false;
+  // a pass-through DMA transfer keeps the UART FIFO full, so it is paused
+  // until the FIFO has room for XON/XOFF (at most 32 characters later)
+  if( rx_flow_char!=0 )
+    {
+      tx_dma_pause(true);
+      if( uart_is_writable(PIN_UART_ID) )
+        {
+          uart_get_hw(PIN_UART_ID)->dr = rx_flow_char;
+          rx_flow_char = 0;
+          tx_dma_pause(false);
+        }
+    }
+}
 
-  if( config_get_serial_xonxoff() )
+
+static void rx_flow_control(uint32_t head, uint32_t level)
+{
+  bool xonxoff = config_get_serial_xonxoff()>0;
+  bool rts     = config_get_serial_rtsmode()==2;
+  if( !xonxoff && !rts )
     {
-      // if xon/xoff is enabled then we maintain our own RX queue
-      // so we can react faster to XON/XOFF requests.
-      res = queue_try_remove(&uart_rx_queue, b);
+      rx_stopped = false;
+      if( rx_flow_char!=0 ) { rx_flow_char = 0; tx_dma_pause(false); }
+      return;
     }
-  else
+
+  if( !rx_stopped && level>rx_high )
+    {
+      if( xonxoff ) rx_send_flow_char(XOFF);
+      if( rts ) gpio_put(PIN_UART_RTS, true);
+      rx_stopped      = true;
+      stats.rx_stops++;
+      rx_stop_time    = get_absolute_time();
+      rx_last_arrival = rx_stop_time;
+      rx_last_head    = head;
+    }
+  else if( rx_stopped )
+    {
+      // remember when data was last received while stopped
+      if( head!=rx_last_head )
+        {
+          rx_last_head    = head;
+          rx_last_arrival = get_absolute_time();
+        }
+
+      if( level<rx_low )
+        {
+          if( xonxoff ) rx_send_flow_char(XON);
+          if( rts ) gpio_put(PIN_UART_RTS, false);
+          rx_stopped = false;
+
+          // adapt to higher latencies immediately and to lower ones slowly
+          uint32_t latency = absolute_time_diff_us(rx_stop_time, rx_last_arrival);
+          if( latency > rx_latency_us )
+            rx_latency_us = latency;
+          else
+            rx_latency_us = (rx_latency_us*7 + latency) / 8;
+          rx_set_watermarks();
+        }
+    }
+
+  // RTS changes immediately, XON/XOFF as soon as the UART FIFO has room
+  rx_flush_flow_char();
+}
+
+
+static uint32_t rx_update()
+{
+  static uint32_t prev_head = 0, prev_lost = 0;
+  uint32_t head  = rx_head();
+  uint32_t level = serial_ring_level(&rx_ring, head);
+
+  stats.rx_uart += head-prev_head;
+  stats.rx_lost += rx_ring.lost-prev_lost;
+  if( level>stats.rx_max_level ) stats.rx_max_level = level;
+  prev_head = head;
+  prev_lost = rx_ring.lost;
+
+  if( config_get_serial_xonxoff()>0 )
     {
-      // if xon/xoff is disabled then we use the built-in 
-      // UART RX buffer for better performance
-      if( uart_is_readable(PIN_UART_ID) ) 
+      // data skipped due to an overrun does not need checking
+      if( (int32_t) (rx_scanned - rx_ring.tail) < 0 ) rx_scanned = rx_ring.tail;
+
+      // react to XON/XOFF as soon as they are received (the characters
+      // themselves are removed from the data when reading it)
+      for(; rx_scanned!=head; rx_scanned++)
         {
-          blink_led(config_get_serial_blink());
-          *b = uart_getc(PIN_UART_ID);
-          res = true;
+          uint8_t b = serial_ring_peek(&rx_ring, rx_scanned);
+          if( b==XON || b==XOFF )
+            {
+              // disable UART transmitter when receiving XOff / enable transmitter when receiving XOn
+              hw_write_masked(&uart_get_hw(PIN_UART_ID)->cr, (b==XON) ? (1 << UART_UARTCR_TXE_LSB) : 0, UART_UARTCR_TXE_BITS);
+            }
         }
     }
+  else
+    rx_scanned = head;
+
+  rx_flow_control(head, level);
+  return head;
+}
+
+
+static size_t rx_read(uint32_t head, uint8_t *buf, size_t n)
+{
+  n = serial_ring_read(&rx_ring, head, buf, n);
+  if( n>0 ) blink_led(config_get_serial_blink());
+
+  if( config_get_serial_xonxoff()>0 )
+    {
+      // XON/XOFF were handled in rx_update(), remove them from the data
+      size_t j = 0;
+      for(size_t i=0; i<n; i++)
+        if( buf[i]!=XON && buf[i]!=XOFF )
+          buf[j++] = buf[i];
+      n = j;
+    }
+
+  return n;
+}
+
+
+size_t serial_uart_receive(uint8_t *buf, size_t n)
+{
+  return rx_read(rx_update(), buf, n);
+}
+
+
+bool serial_uart_receive_char_raw(uint8_t *b)
+{
+  // receive without XON/XOFF handling (for binary transfers)
+  return serial_ring_read(&rx_ring, rx_head(), b, 1)>0;
+}
+
+
+void serial_uart_send_dma(const uint8_t *buf, size_t n)
+{
+  // buf must stay unchanged until serial_uart_send_dma_busy() returns false
+  blink_led(config_get_serial_blink());
+  dma_channel_transfer_from_buffer_now(TX_DMA_CHANNEL, buf, n);
+}
 
-  return res;
+
+bool serial_uart_send_dma_busy()
+{
+  return dma_channel_is_busy(TX_DMA_CHANNEL);
 }
 
 
 bool serial_uart_readable()
 {
-  return config_get_serial_xonxoff() ? !queue_is_empty(&uart_rx_queue) : uart_is_readable(PIN_UART_ID);
+  return serial_ring_level(&rx_ring, rx_head())>0;
 }
 
 
@@ -147,7 +387,12 @@ void serial_uart_apply_settings()
       break;
 
     case 2:
-      gpio_set_function(PIN_UART_RTS, GPIO_FUNC_UART);
+      // RTS follows the receive buffer level (see rx_flow_control), the
+      // hardware RTS would only follow the UART FIFO which is emptied by DMA
+      gpio_set_function(PIN_UART_RTS, GPIO_FUNC_NULL);
+      gpio_init(PIN_UART_RTS);
+      gpio_set_dir(PIN_UART_RTS, true); // output
+      gpio_put(PIN_UART_RTS, rx_stopped);
       break;
     }
 
@@ -164,7 +409,8 @@ void serial_uart_apply_settings()
       break;
     }
 
-  uart_set_hw_flow(PIN_UART_ID, config_get_serial_ctsmode(), config_get_serial_rtsmode());
+  uart_set_hw_flow(PIN_UART_ID, config_get_serial_ctsmode(), false);
+  rx_set_watermarks();
 
   // make sure transmitter is always enabled if Xon/Xoff flow control is disabled
   if( config_get_serial_xonxoff()==0 )
@@ -177,51 +423,24 @@ void serial_uart_apply_settings()
 }
 
 
-void serial_uart_task(bool processInput)
+size_t serial_uart_task(bool processInput)
 {
-  static bool isxon = true;
-  uint8_t b;
+  size_t n = 0;
   
   // send serial output if we have some buffered
-  if( !queue_is_empty(&uart_tx_queue) && uart_is_writable(PIN_UART_ID) )
-    {
-      if( queue_try_remove(&uart_tx_queue, &b) ) 
-        {
-          blink_led(config_get_serial_blink());
-          uart_get_hw(PIN_UART_ID)->dr = b;
-        }
-    }
+  if( tx_fill_fifo()>0 )
+    blink_led(config_get_serial_blink());
 
   // handle XON/XOFF flow control
-  if( config_get_serial_xonxoff()>0 )
-    {
-      // if xon/xoff is enabled then we maintain our own RX queue
-      // so we can react faster to XON/XOFF requests.
-      if( uart_is_readable(PIN_UART_ID) )
-        {
-          blink_led(config_get_serial_blink());
+  uint32_t head = rx_update();
 
-          b = uart_getc(PIN_UART_ID);
-          if( b==XON || b==XOFF )
-            {
-              // disable UART transmitter when receiving XOff / enable transmitter when receiving XOn
-              hw_write_masked(&uart_get_hw(PIN_UART_ID)->cr, (b==XON) ? (1 << UART_UARTCR_TXE_LSB) : 0, UART_UARTCR_TXE_BITS);
-            }
-          else
-            {
-              queue_try_add(&uart_rx_queue, &b);
-
-              // send XOFF if our receive queue is almost full
-              if( queue_get_level(&uart_rx_queue)>20 && isxon )
-                { uart_get_hw(PIN_UART_ID)->dr = XOFF; isxon = false; }
-            }
-        }
-      else if( queue_get_level(&uart_rx_queue)<12 && !isxon )
-        {
-          // send XON if our receive queue is emptying again
-          uart_get_hw(PIN_UART_ID)->dr = XON;
-          isxon = true;
-        }
+  // count receive errors (the status flags are cleared by writing the register)
+  uint32_t rsr = uart_get_hw(PIN_UART_ID)->rsr;
+  if( rsr!=0 )
+    {
+      if( rsr & UART_UARTRSR_OE_BITS ) stats.uart_overruns++;
+      if( rsr & UART_UARTRSR_FE_BITS ) stats.uart_framing_errors++;
+      uart_get_hw(PIN_UART_ID)->rsr = 0;
     }
 
   // handle LED flashing
@@ -229,25 +448,31 @@ void serial_uart_task(bool processInput)
     { offtime = 0; gpio_put(PIN_LED, false); }
 
   // handle serial input
-  if( processInput && serial_uart_receive_char(&b) )
+  if( processInput )
     {
+      uint8_t buf[64];
       switch( config_get_usb_cdcmode() )
         {
         case 0: // disabled
         case 1: // regular serial
-          terminal_receive_char(b);
+        case 4: // separate console
+          // collect all input that is available right now so the terminal
+          // can process it as one chunk
+          n = rx_read(head, buf, sizeof(buf));
+          if( n>0 ) terminal_console_receive_buffer(TERMINAL_CONSOLE_MAIN, buf, n);
           break;
-
+          
         case 2: // pass-through
-          terminal_receive_char(b);
-          serial_cdc_send_char(b);
+          n = serial_bridge_uart_to_cdc(true);
           break;
-
+          
         case 3: // pass-through (terminal disabled)
-          serial_cdc_send_char(b);
+          n = serial_bridge_uart_to_cdc(false);
           break;
         }
     }
+
+  return n;
 }
 
 
@@ -258,7 +483,30 @@ void serial_uart_init()
   gpio_set_dir(PIN_LED, true); // output
   blink_led(1000);
 
-  queue_init(&uart_tx_queue, 1, 512);
-  queue_init(&uart_rx_queue, 1, 32);
+  tx_queue_head = tx_queue_tail = 0;
   serial_uart_apply_settings();
+
+  // received data goes into the ring buffer via DMA
+  dma_channel_claim(RX_DMA_CHANNEL);
+  dma_channel_config cfg = dma_channel_get_default_config(RX_DMA_CHANNEL);
+  channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+  channel_config_set_read_increment(&cfg, false);
+  channel_config_set_write_increment(&cfg, true);
+  channel_config_set_ring(&cfg, true, __builtin_ctz(RX_RING_SIZE));
+  channel_config_set_dreq(&cfg, uart_get_dreq(PIN_UART_ID, false));
+  hw_set_bits(&uart_get_hw(PIN_UART_ID)->dmacr, UART_UARTDMACR_RXDMAE_BITS);
+  rx_dma_base = 0;
+  rx_scanned  = 0;
+  serial_ring_init(&rx_ring, rx_buf, RX_RING_SIZE, 0);
+  dma_channel_configure(RX_DMA_CHANNEL, &cfg, rx_buf, &uart_get_hw(PIN_UART_ID)->dr, 0xFFFFFFFF, true);
+
+  // block transfers to the UART (USB pass-through) are sent via DMA
+  dma_channel_claim(TX_DMA_CHANNEL);
+  cfg = dma_channel_get_default_config(TX_DMA_CHANNEL);
+  channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+  channel_config_set_read_increment(&cfg, true);
+  channel_config_set_write_increment(&cfg, false);
+  channel_config_set_dreq(&cfg, uart_get_dreq(PIN_UART_ID, true));
+  hw_set_bits(&uart_get_hw(PIN_UART_ID)->dmacr, UART_UARTDMACR_TXDMAE_BITS);
+  dma_channel_configure(TX_DMA_CHANNEL, &cfg, &uart_get_hw(PIN_UART_ID)->dr, NULL, 0, false);
 }
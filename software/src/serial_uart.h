@@ -20,13 +20,20 @@
 #ifndef SERIAL_UART
 #define SERIAL_UART
 
+#include <stddef.h>
+
 void serial_uart_set_break(bool set);
 void serial_uart_send_char(char c);
 void serial_uart_send_string(const char *s);
+void serial_uart_send_buffer(const char *buf, size_t n);
 bool serial_uart_readable();
+bool serial_uart_receive_char_raw(uint8_t *b);
+size_t serial_uart_receive(uint8_t *buf, size_t n);
+void serial_uart_send_dma(const uint8_t *buf, size_t n);
+bool serial_uart_send_dma_busy();
 int  serial_uart_can_send();
 
-void serial_uart_task(bool processInput);
+size_t serial_uart_task(bool processInput);
 void serial_uart_apply_settings();
 void serial_uart_init();
 
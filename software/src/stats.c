@@ -0,0 +1,53 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+struct stats stats;
+
+
+void stats_reset()
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+
+void stats_loop_time(uint32_t us)
+{
+  stats.loop_count++;
+  stats.loop_total_us += us;
+  if( us>stats.loop_max_us ) stats.loop_max_us = us;
+}
+
+
+int stats_format_report(char *buf, size_t len)
+{
+  uint32_t parser_ns = stats.parser_bytes>0 ? (uint32_t) ((uint64_t) stats.parser_us*1000 / stats.parser_bytes) : 0;
+  uint32_t loop_avg  = stats.loop_count>0 ? stats.loop_total_us / stats.loop_count : 0;
+
+  return snprintf(buf, len, "\033[?200;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lun",
+                  (unsigned long) stats.rx_uart, (unsigned long) stats.rx_cdc,
+                  (unsigned long) stats.uart_overruns, (unsigned long) stats.uart_framing_errors,
+                  (unsigned long) stats.rx_lost, (unsigned long) stats.rx_stops,
+                  (unsigned long) stats.rx_max_level, (unsigned long) parser_ns,
+                  (unsigned long) stats.scrolls, (unsigned long) stats.loop_max_us,
+                  (unsigned long) loop_avg);
+}
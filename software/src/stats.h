@@ -0,0 +1,57 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Runtime performance counters. The host can read them with the private
+// query "ESC [ ? 200 n" ("ESC [ ? 201 n" also resets them afterwards),
+// the reply is "ESC [ ? 200 ; v1 ; v2 ; ... n" with these values:
+//   1  bytes received from the UART
+//   2  bytes received from USB CDC
+//   3  UART receive overruns (hardware FIFO)
+//   4  UART framing errors
+//   5  bytes lost due to receive ring buffer overruns
+//   6  number of times the sender was stopped (XOFF sent / RTS de-asserted)
+//   7  maximum number of bytes waiting in the receive ring buffer
+//   8  average terminal processing time per received byte (nanoseconds)
+//   9  number of lines scrolled
+//  10  maximum main loop iteration time (microseconds)
+//  11  average main loop iteration time (microseconds)
+
+struct stats
+{
+  uint32_t rx_uart, rx_cdc;
+  uint32_t uart_overruns, uart_framing_errors, rx_lost;
+  uint32_t rx_stops, rx_max_level;
+  uint32_t parser_bytes, parser_us;
+  uint32_t scrolls;
+  uint32_t loop_count, loop_total_us, loop_max_us;
+};
+
+extern struct stats stats;
+
+void stats_reset();
+void stats_loop_time(uint32_t us);
+int  stats_format_report(char *buf, size_t len);
+
+#endif
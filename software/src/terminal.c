@@ -23,8 +23,11 @@
 #include "config.h"
 #include "pins.h"
 #include "serial.h"
+#include "serial_cdc.h"
 #include "sound.h"
 #include "keyboard.h"
+#include "stats.h"
+#include "profile.h"
 #include "hardware/uart.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,25 +39,95 @@ void wait(uint32_t milliseconds);
 
 #define INFLASHFUN __in_flash(".terminalfun") 
 
-#define TS_NORMAL      0
-#define TS_WAITBRACKET 1
-#define TS_STARTCHAR   2 
-#define TS_READPARAM   3
-#define TS_HASH        4
-#define TS_READCHAR    5
+// parser states, GROUND and ESCAPE are shared by the VT102 and VT52 parsers
+#define PS_GROUND            0
+#define PS_ESCAPE            1
+#define PS_ESC_INTERMEDIATE  2
+#define PS_CSI_ENTRY         3
+#define PS_CSI_PARAM         4
+#define PS_CSI_INTERMEDIATE  5
+#define PS_CSI_IGNORE        6
+#define PS_OSC_STRING        7
+#define PS_STRING_IGNORE     8
+#define PS_VT102_NUM         9
+
+#define PS_VT52_ROW          2
+#define PS_VT52_COL          3
+#define PS_VT52_FG           4
+#define PS_VT52_BG           5
+#define PS_VT52_NUM          6
+
+// parser actions
+#define PA_NONE              0
+#define PA_EXECUTE           1
+#define PA_PRINT             2
+#define PA_CLEAR             3
+#define PA_COLLECT           4
+#define PA_PRIVATE           5
+#define PA_PARAM             6
+#define PA_ESC_DISPATCH      7
+#define PA_CSI_DISPATCH      8
+#define PA_VT52_ROW          9
+#define PA_VT52_COL          10
+#define PA_VT52_FG           11
+#define PA_VT52_BG           12
+
+// a transition table entry holds the action in the upper and the next state in the lower 4 bits
+#define T(action, state) ((PA_##action << 4) | PS_##state)
+
+// C0 control characters within escape sequences: CAN and SUB cancel the
+// sequence, ESC starts a new one, all others are executed immediately
+#define T_C0(state) \
+  [0x00 ... 0x17] = T(EXECUTE, state), [0x18] = T(NONE, GROUND), [0x19] = T(EXECUTE, state), \
+  [0x1A] = T(NONE, GROUND), [0x1B] = T(CLEAR, ESCAPE), [0x1C ... 0x1F] = T(EXECUTE, state)
 
 #define CS_TEXT_US  0
 #define CS_TEXT_UK  1
 #define CS_GRAPHICS 2
 
-static uint8_t terminal_state = TS_NORMAL;
-static uint8_t color_fg, color_bg, attr = 0, cur_attr = 0;
-static int cursor_col = 0, cursor_row = 0, saved_col = 0, saved_row = 0;
-static int scroll_region_start, scroll_region_end;
-static bool cursor_shown = true, origin_mode = false, cursor_eol = false, auto_wrap_mode = true, vt52_mode = false, localecho = false;
-static bool saved_eol = false, saved_origin_mode = false, insert_mode = false;
-static bool petscii_lower_case_charset = true;
-static uint8_t saved_attr, saved_fg, saved_bg, saved_charset_G0, saved_charset_G1, *charset, charset_G0, charset_G1, tabs[255];
+// state of one terminal session (console), each console draws to its own
+// pair of frame buffer pages (normal and alternate screen)
+struct TerminalContextStruct
+{
+  uint8_t terminal_state;
+  uint8_t color_fg, color_bg, attr;
+  int cursor_col, cursor_row, saved_col, saved_row;
+  int scroll_region_start, scroll_region_end;
+  int margin_left, margin_right; // left/right margins (DECSLRM)
+  bool cursor_shown, origin_mode, cursor_eol, auto_wrap_mode, vt52_mode, localecho;
+  bool saved_eol, saved_origin_mode, insert_mode, smooth_scroll, screen_inverted;
+  bool petscii_lower_case_charset, lr_margin_mode;
+  uint8_t saved_attr, saved_fg, saved_bg, saved_charset_G0, saved_charset_G1, *charset, charset_G0, charset_G1, tabs[255];
+
+  // escape sequence being received (VT102), cursor row being received (VT52)
+  uint8_t intermediate, start_char, num_params, vt52_row;
+  uint16_t params[17];
+  uint32_t subparams; // bit n set if params[n] followed ':' instead of ';'
+
+  // PETSCII quote mode and number of characters inserted by INST
+  bool petscii_quote_mode;
+  uint8_t petscii_inserted;
+
+  // frame buffer page currently drawn to
+  uint8_t page;
+};
+
+// settings used for every received character, compiled by terminal_init()
+// so the receive path does not query the configuration
+static struct
+{
+  uint8_t rx_mask;                  // 0x7f if bit 7 of received characters is cleared
+  bool    print_runs;               // runs of printable characters bypass the parser
+  void  (*receive_char)(uint8_t c); // parser for the terminal type
+} policy;
+
+static struct TerminalContextStruct consoles[TERMINAL_NUM_CONSOLES];
+static struct TerminalContextStruct *term = &consoles[0]; // console being processed
+static uint8_t visible_console = 0;
+
+// input following the character currently being processed
+static const uint8_t *lookahead = NULL;
+static size_t lookahead_len = 0;
 
 
 static uint8_t INFLASHFUN get_charset(char c)
@@ -72,8 +145,18 @@ static uint8_t INFLASHFUN get_charset(char c)
 }
 
 
+static bool INFLASHFUN is_visible()
+{
+  return term==&consoles[visible_console];
+}
+
+
 static void INFLASHFUN show_cursor(bool show)
 {
+  // the cursor is drawn by the video renderer on top of the screen contents,
+  // consoles that are not visible have their cursor drawn when switched to
+  if( !is_visible() ) return;
+
   uint8_t attr = ATTR_INVERSE;
   switch( config_get_terminal_cursortype() )
     {
@@ -81,40 +164,155 @@ static void INFLASHFUN show_cursor(bool show)
     case 2: attr = ATTR_UNDERLINE; break;
     }
   
-  framebuf_set_attr(cursor_col, cursor_row, show ? (cur_attr ^ attr) : cur_attr);
+  framebuf_set_cursor(term->cursor_col, term->cursor_row, (show && term->cursor_row>=0 && term->cursor_col>=0) ? attr : 0);
+}
+
+
+static void INFLASHFUN set_page(uint8_t page)
+{
+  term->page = page;
+  framebuf_set_page(page);
+  if( is_visible() ) framebuf_show_page(page);
+}
+
+
+static void INFLASHFUN set_screen_inverted(bool invert)
+{
+  term->screen_inverted = invert;
+  if( is_visible() ) framebuf_set_screen_inverted(invert);
+}
+
+
+static void INFLASHFUN select_console(uint8_t console)
+{
+  // frame buffer operations from here on go to the console's current page
+  term = &consoles[console];
+  framebuf_set_page(term->page);
+  framebuf_set_scroll_delay(term->smooth_scroll ? config_get_terminal_scrolldelay() : 0);
+}
+
+
+static bool INFLASHFUN in_lr_margins()
+{
+  return term->cursor_col>=term->margin_left && term->cursor_col<=term->margin_right;
+}
+
+
+static int INFLASHFUN left_edge()
+{
+  // column that carriage return and auto-wrap go to
+  return in_lr_margins() ? term->margin_left : 0;
+}
+
+
+static int INFLASHFUN right_edge()
+{
+  // last column for printing and inserting/deleting characters: the right
+  // margin unless the cursor is to the right of it
+  int ncols = framebuf_get_ncols(term->cursor_row);
+  return term->cursor_col<=term->margin_right && term->margin_right<ncols ? term->margin_right : ncols-1;
+}
+
+
+static void INFLASHFUN reset_lr_margins()
+{
+  term->margin_left  = 0;
+  term->margin_right = framebuf_get_ncols(-1)-1;
+}
+
+
+static bool INFLASHFUN have_lr_margins()
+{
+  return term->margin_left>0 || term->margin_right<framebuf_get_ncols(-1)-1;
+}
+
+
+static void INFLASHFUN scroll_region(int top_limit, int bottom_limit, int n)
+{
+  // scroll the rows top_limit..bottom_limit, if left/right margins are set
+  // then only the area within them scrolls and only if the cursor is inside
+  if( !have_lr_margins() )
+    framebuf_scroll_region(top_limit, bottom_limit, n, term->color_fg, term->color_bg);
+  else if( in_lr_margins() )
+    framebuf_scroll_rect(term->margin_left, top_limit, term->margin_right, bottom_limit, n, term->color_fg, term->color_bg);
 }
 
 
 static void INFLASHFUN move_cursor_wrap(int row, int col)
 {
-  if( row!=cursor_row || col!=cursor_col )
+  if( row!=term->cursor_row || col!=term->cursor_col )
     {
-      int top_limit    = scroll_region_start;
-      int bottom_limit = scroll_region_end;
-      
-      if( cursor_shown && cursor_row>=0 && cursor_col>=0 ) show_cursor(false);
+      int top_limit    = term->scroll_region_start;
+      int bottom_limit = term->scroll_region_end;
       
       while( col<0 )                        { col += framebuf_get_ncols(row); row--; }
-      while( row<top_limit )                { row++; framebuf_scroll_region(top_limit, bottom_limit, -1, color_fg, color_bg); }
+      while( row<top_limit )                { row++; scroll_region(top_limit, bottom_limit, -1); }
       while( col>=framebuf_get_ncols(row) ) { col -= framebuf_get_ncols(row); row++; }
-      while( row>bottom_limit )             { row--; framebuf_scroll_region(top_limit, bottom_limit, 1, color_fg, color_bg); }
+      while( row>bottom_limit )             { row--; scroll_region(top_limit, bottom_limit, 1); }
 
-      cursor_row = row;
-      cursor_col = col;
-      cursor_eol = false;
+      term->cursor_row = row;
+      term->cursor_col = col;
+      term->cursor_eol = false;
       
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      if( cursor_shown ) show_cursor(true);
+      if( term->cursor_shown ) show_cursor(true);
     }
 }
 
 
-static void INFLASHFUN move_cursor_within_region(int row, int col, int top_limit, int bottom_limit)
+static int INFLASHFUN count_scrolling_linefeeds(int max)
 {
-  if( row!=cursor_row || col!=cursor_col )
+  // count the current plus any following line feeds in the received input
+  // that will scroll the region. Stops at anything that could move the cursor
+  // up or otherwise change what the scrolled-in lines should look like.
+  uint8_t mask = policy.rx_mask;
+  bool lf_scrolls = config_get_terminal_lf()>=2, cr_scrolls = config_get_terminal_cr()>=2;
+  int n = 1;
+
+  for(size_t i=0; i<lookahead_len && n<max; i++)
     {
-      if( cursor_shown && cursor_row>=0 && cursor_col>=0 ) show_cursor(false);
+      uint8_t c = lookahead[i] & mask;
+      if( c==10 || c==11 || c==12 )
+        { if( lf_scrolls ) n++; }
+      else if( c==13 )
+        { if( cr_scrolls ) n++; }
+      else if( c!='\t' && (c<32 || c==127) )
+        break;
+    }
 
+  return n;
+}
+
+
+static void INFLASHFUN linefeed(int col)
+{
+  // no jump scroll with left/right margins: tabs, text and carriage returns
+  // in the pending input can move the cursor out of the margins (which
+  // stops the scrolling) and double-width rows do not move with the rectangle.
+  // Also not within an escape sequence (line feeds are executed there) since
+  // the pending input then starts with the rest of that sequence.
+  int n = 1;
+  if( term->cursor_row==term->scroll_region_end && !term->smooth_scroll && 
+      !have_lr_margins() && term->terminal_state==PS_GROUND ) 
+    n = count_scrolling_linefeeds(term->scroll_region_end-term->scroll_region_start+1);
+
+  if( n>1 )
+    {
+      // jump scroll: scroll for all line feeds in the pending input at once,
+      // the following line feeds will then just move the cursor down
+      scroll_region(term->scroll_region_start, term->scroll_region_end, n);
+      term->cursor_row = -1;
+      term->cursor_col = -1;
+      move_cursor_wrap(term->scroll_region_end-n+1, col);
+    }
+  else
+    move_cursor_wrap(term->cursor_row+1, col);
+}
+
+
+static void INFLASHFUN move_cursor_within_region(int row, int col, int top_limit, int bottom_limit)
+{
+  if( row!=term->cursor_row || col!=term->cursor_col )
+    {
       if( col<0 ) 
         col = 0;
       else if( col>=framebuf_get_ncols(row) )
@@ -125,12 +323,11 @@ static void INFLASHFUN move_cursor_within_region(int row, int col, int top_limit
       else if( row>bottom_limit )
         row = bottom_limit;
           
-      cursor_row = row;
-      cursor_col = col;
-      cursor_eol = false;
+      term->cursor_row = row;
+      term->cursor_col = col;
+      term->cursor_eol = false;
 
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      if( cursor_shown ) show_cursor(true);
+      if( term->cursor_shown ) show_cursor(true);
     }
 }
 
@@ -139,117 +336,182 @@ static void INFLASHFUN move_cursor_limited(int row, int col)
 {
   // only move if cursor is currently within scroll region, do not move
   // outside of scroll region
-  if( cursor_row >= scroll_region_start && cursor_row <= scroll_region_end )
-    move_cursor_within_region(row, col, scroll_region_start, scroll_region_end);
+  if( term->cursor_row >= term->scroll_region_start && term->cursor_row <= term->scroll_region_end )
+    move_cursor_within_region(row, col, term->scroll_region_start, term->scroll_region_end);
 }
 
 
 
 static void INFLASHFUN init_cursor(int row, int col)
 {
-  cursor_row = -1;
-  cursor_col = -1;
+  term->cursor_row = -1;
+  term->cursor_col = -1;
   move_cursor_within_region(row, col, 0, framebuf_get_nrows()-1);
 }
 
 
 static void INFLASHFUN print_char_vt(char c)
 {
-  if( cursor_eol ) 
+  if( term->cursor_eol ) 
     { 
       // cursor was already past the end of the line => move it to the next line now
-      move_cursor_wrap(cursor_row+1, 0); 
-      cursor_eol=false; 
+      move_cursor_wrap(term->cursor_row+1, left_edge()); 
+      term->cursor_eol=false; 
     }
 
-  if( insert_mode )
+  if( term->insert_mode )
+    framebuf_insert(term->cursor_col, right_edge(), term->cursor_row, 1, term->color_fg, term->color_bg);
+
+  if( *term->charset==CS_TEXT_UK && c==35 )
+    c=font_map_graphics_char(125, (term->attr & ATTR_BOLD)!=0); // pound sterling symbol
+  else if( *term->charset==CS_GRAPHICS )
+    c=font_map_graphics_char(c, (term->attr & ATTR_BOLD)!=0);
+  
+  framebuf_set_color(term->cursor_col, term->cursor_row, term->color_fg, term->color_bg);
+  framebuf_set_attr(term->cursor_col, term->cursor_row, term->attr);
+  framebuf_set_char(term->cursor_col, term->cursor_row, c);
+
+  int right = right_edge();
+  if( term->auto_wrap_mode && term->cursor_col==right )
     {
-      show_cursor(false);
-      framebuf_insert(cursor_col, cursor_row, 1, color_fg, color_bg);
+      // cursor stays in last column but will wrap if another character is typed
+      show_cursor(term->cursor_shown);
+      term->cursor_eol=true;
     }
+  else
+    init_cursor(term->cursor_row, MIN(term->cursor_col+1, right));
+}
 
-  if( *charset==CS_TEXT_UK && c==35 )
-    c=font_map_graphics_char(125, (attr & ATTR_BOLD)!=0); // pound sterling symbol
-  else if( *charset==CS_GRAPHICS )
-    c=font_map_graphics_char(c, (attr & ATTR_BOLD)!=0);
-  
-  framebuf_set_color(cursor_col, cursor_row, color_fg, color_bg);
-  framebuf_set_attr(cursor_col, cursor_row, attr);
-  framebuf_set_char(cursor_col, cursor_row, c);
 
-  if( auto_wrap_mode && cursor_col==framebuf_get_ncols(cursor_row)-1 )
+static size_t INFLASHFUN print_run_vt(const uint8_t *buf, size_t len)
+{
+  // Prints a run of plain printable characters at the cursor position using
+  // a single framebuffer span write. Stops at the end of the current row.
+  // Returns the number of characters consumed from buf, 0 if the first
+  // character must go through the regular parser.
+  uint8_t span[MAX_COLS];
+  uint8_t mask = policy.rx_mask;
+  size_t i, n, ncols;
+
+  if( term->terminal_state!=PS_GROUND || term->insert_mode || *term->charset!=CS_TEXT_US )
+    return 0;
+
+  for(n=0; n<len; n++)
+    {
+      uint8_t c = buf[n] & mask;
+      if( c<32 || c==127 ) break;
+    }
+
+  if( n==0 ) return 0;
+
+  if( term->cursor_eol ) 
+    { 
+      // cursor was already past the end of the line => move it to the next line now
+      move_cursor_wrap(term->cursor_row+1, left_edge()); 
+      term->cursor_eol=false; 
+    }
+
+  // the row ends at the right margin if the cursor is not past it
+  if( term->cursor_col>=framebuf_get_ncols(term->cursor_row) ) return 0;
+  ncols = right_edge()+1;
+
+  i = MIN(n, ncols-term->cursor_col);
+  if( term->auto_wrap_mode ) n = i;
+  for(size_t j=0; j<i; j++) span[j] = buf[j] & mask;
+
+  // without auto-wrap, all characters past the end of the row (or right margin) go to the last column
+  if( n>i ) span[i-1] = buf[n-1] & mask;
+
+  framebuf_set_span(term->cursor_col, term->cursor_row, span, i, term->attr, term->color_fg, term->color_bg);
+
+  if( term->auto_wrap_mode && term->cursor_col+i==ncols )
     {
       // cursor stays in last column but will wrap if another character is typed
-      cur_attr = attr;
-      show_cursor(cursor_shown);
-      cursor_eol=true;
+      term->cursor_col = ncols-1;
+      show_cursor(term->cursor_shown);
+      term->cursor_eol=true;
     }
   else
-    init_cursor(cursor_row, cursor_col+1);
+    init_cursor(term->cursor_row, MIN(term->cursor_col+i, ncols-1));
+
+  return n;
 }
 
 
 static void INFLASHFUN print_char_petscii(char c)
 {
-  framebuf_set_color(cursor_col, cursor_row, color_fg, color_bg);
-  framebuf_set_attr(cursor_col, cursor_row, attr);
-  framebuf_set_char(cursor_col, cursor_row, c);
-  int row = cursor_row, col = cursor_col;
-  cursor_row = -1;
-  cursor_col = -1;
+  framebuf_set_color(term->cursor_col, term->cursor_row, term->color_fg, term->color_bg);
+  framebuf_set_attr(term->cursor_col, term->cursor_row, term->attr);
+  framebuf_set_char(term->cursor_col, term->cursor_row, c);
+  int row = term->cursor_row, col = term->cursor_col;
+  term->cursor_row = -1;
+  term->cursor_col = -1;
   move_cursor_wrap(row, col+1);
 }
 
 
 void INFLASHFUN terminal_reset()
 {
-  saved_col = 0;
-  saved_row = 0;
-  cursor_shown = true;
-  color_fg = config_get_terminal_default_fg();
-  color_bg = config_get_terminal_default_bg();
-  scroll_region_start = 0;
-  scroll_region_end = framebuf_get_nrows()-1;
-  origin_mode = false;
-  cursor_eol = false;
-  auto_wrap_mode = true;
-  insert_mode = false;
-  vt52_mode = false;
-  attr = config_get_terminal_default_attr();
-  saved_attr = 0;
-  charset_G0 = CS_TEXT_US;
-  charset_G1 = CS_GRAPHICS;
-  saved_charset_G0 = CS_TEXT_US;
-  saved_charset_G1 = CS_GRAPHICS;
-  charset = &charset_G0;
-  memset(tabs, 0, framebuf_get_ncols(-1));
+  term->terminal_state = PS_GROUND;
+  term->saved_col = 0;
+  term->saved_row = 0;
+  term->cursor_shown = true;
+  term->color_fg = config_get_terminal_default_fg();
+  term->color_bg = config_get_terminal_default_bg();
+  term->scroll_region_start = 0;
+  term->scroll_region_end = framebuf_get_nrows()-1;
+  term->lr_margin_mode = false;
+  reset_lr_margins();
+  term->origin_mode = false;
+  term->cursor_eol = false;
+  term->auto_wrap_mode = true;
+  term->insert_mode = false;
+  term->vt52_mode = false;
+  term->attr = config_get_terminal_default_attr();
+  term->saved_attr = 0;
+  term->charset_G0 = CS_TEXT_US;
+  term->charset_G1 = CS_GRAPHICS;
+  term->saved_charset_G0 = CS_TEXT_US;
+  term->saved_charset_G1 = CS_GRAPHICS;
+  term->charset = &term->charset_G0;
+  memset(term->tabs, 0, framebuf_get_ncols(-1));
   framebuf_set_scroll_delay(0);
-  localecho = config_get_terminal_localecho();
-  petscii_lower_case_charset = true;
+  term->smooth_scroll = false;
+  term->localecho = config_get_terminal_localecho();
+  term->petscii_lower_case_charset = true;
 }
 
 
 void INFLASHFUN terminal_clear_screen()
 {
-  framebuf_fill_screen(' ', color_fg, color_bg);
+  framebuf_fill_screen(' ', term->color_fg, term->color_bg);
   init_cursor(0, 0);
-  scroll_region_start = 0;
-  scroll_region_end = framebuf_get_nrows()-1;
-  origin_mode = false;
+  term->scroll_region_start = 0;
+  term->scroll_region_end = framebuf_get_nrows()-1;
+  reset_lr_margins();
+  term->origin_mode = false;
 }
 
 
 static void INFLASHFUN send_char(char c)
 {
-  serial_send_char(c);
-  if( localecho ) terminal_receive_char(c);
+  if( term==&consoles[TERMINAL_CONSOLE_USB] )
+    serial_cdc_send_char(c);
+  else
+    serial_send_char(c);
+
+  if( term->localecho ) terminal_receive_char(c);
 }
 
 
 static void INFLASHFUN send_string(const char *s)
 {
-  serial_send_string(s);
-  if( localecho ) terminal_receive_string(s);
+  if( term==&consoles[TERMINAL_CONSOLE_USB] )
+    serial_cdc_send_string(s);
+  else
+    serial_send_string(s);
+
+  if( term->localecho ) terminal_receive_string(s);
 }
 
 
@@ -275,18 +537,17 @@ static INFLASHFUN void terminal_process_text(char c)
         uint8_t mode = c==8 ? config_get_terminal_bs() : config_get_terminal_del();
         if( mode>0 )
           {
-            int top_limit = origin_mode ? scroll_region_start : 0;
-            if( cursor_row>top_limit )
-              move_cursor_wrap(cursor_row, cursor_col-1);
+            int top_limit = term->origin_mode ? term->scroll_region_start : 0;
+            if( term->cursor_row>top_limit )
+              move_cursor_wrap(term->cursor_row, term->cursor_col-1);
             else
-              move_cursor_limited(cursor_row, cursor_col-1);
+              move_cursor_limited(term->cursor_row, term->cursor_col-1);
 
             if( mode==2 )
               {
-                framebuf_set_char(cursor_col, cursor_row, ' ');
-                framebuf_set_attr(cursor_col, cursor_row, 0);
-                cur_attr = 0;
-                show_cursor(cursor_shown);
+                framebuf_set_char(term->cursor_col, term->cursor_row, ' ');
+                framebuf_set_attr(term->cursor_col, term->cursor_row, 0);
+                show_cursor(term->cursor_shown);
               }
           }
 
@@ -295,9 +556,11 @@ static INFLASHFUN void terminal_process_text(char c)
 
     case '\t': // horizontal tab
       {
-        int col = cursor_col+1;
-        while( col < framebuf_get_ncols(cursor_row)-1 && !tabs[col] ) col++;
-        move_cursor_limited(cursor_row, col); 
+        // tabs stop at the right margin if the cursor is within the margins
+        int right = in_lr_margins() ? term->margin_right : framebuf_get_ncols(term->cursor_row)-1;
+        int col = term->cursor_col+1;
+        while( col < right && !term->tabs[col] ) col++;
+        move_cursor_limited(term->cursor_row, MIN(col, right)); 
         break;
       }
       
@@ -308,19 +571,19 @@ static INFLASHFUN void terminal_process_text(char c)
       {
         switch( c=='\r' ? config_get_terminal_cr() : config_get_terminal_lf() )
           {
-          case 1: move_cursor_wrap(cursor_row, 0); break;
-          case 2: move_cursor_wrap(cursor_row+1, cursor_col); break;
-          case 3: move_cursor_wrap(cursor_row+1, 0); break;
+          case 1: move_cursor_wrap(term->cursor_row, left_edge()); break;
+          case 2: linefeed(term->cursor_col); break;
+          case 3: linefeed(left_edge()); break;
           }
         break;
       }
 
     case 14:  // SO
-      charset = &charset_G1; 
+      term->charset = &term->charset_G1; 
       break;
 
     case 15:  // SI
-      charset = &charset_G0; 
+      term->charset = &term->charset_G0; 
       break;
 
     default: // regular character
@@ -330,7 +593,84 @@ static INFLASHFUN void terminal_process_text(char c)
 }
 
 
-static void INFLASHFUN terminal_process_command(char start_char, char final_char, uint8_t num_params, uint8_t *params)
+static void INFLASHFUN terminal_process_command(char start_char, char final_char, uint8_t num_params, uint16_t *params);
+
+
+static void INFLASHFUN set_alternate_screen(bool enabled, uint16_t mode)
+{
+  // the normal and alternate screen are separate frame buffer pages so
+  // switching between them does not need to redraw anything
+  uint16_t clear = 2;
+  if( enabled && (term->page & 1)==0 )
+    {
+      if( mode==1049 ) terminal_process_command(0, 's', 0, NULL);
+      set_page(term->page | 1);
+      if( mode==1049 ) terminal_process_command(0, 'J', 1, &clear);
+    }
+  else if( !enabled && (term->page & 1)!=0 )
+    {
+      if( mode==1047 ) terminal_process_command(0, 'J', 1, &clear);
+      set_page(term->page & ~1);
+      if( mode==1049 ) terminal_process_command(0, 'u', 0, NULL);
+    }
+
+  show_cursor(term->cursor_shown);
+}
+
+
+static uint8_t INFLASHFUN rgb_to_color(uint16_t r, uint16_t g, uint16_t b)
+{
+  // nearest color of the xterm 256-color palette (6x6x6 color cube or
+  // one of 24 shades of grey) for a 24-bit RGB color
+  static const uint8_t cube[6] = {0, 95, 135, 175, 215, 255};
+  r = MIN(r, 255); g = MIN(g, 255); b = MIN(b, 255);
+
+  uint8_t cr = r<48 ? 0 : r<115 ? 1 : (r-35)/40;
+  uint8_t cg = g<48 ? 0 : g<115 ? 1 : (g-35)/40;
+  uint8_t cb = b<48 ? 0 : b<115 ? 1 : (b-35)/40;
+  int dr = r-cube[cr], dg = g-cube[cg], db = b-cube[cb];
+  int cube_dist = dr*dr + dg*dg + db*db;
+
+  int avg = (r+g+b)/3;
+  uint8_t grey = avg<8 ? 0 : avg>=238 ? 23 : (avg-3)/10;
+  int v = 8 + grey*10;
+  int grey_dist = (r-v)*(r-v) + (g-v)*(g-v) + (b-v)*(b-v);
+
+  return grey_dist<cube_dist ? 232 + grey : 16 + cr*36 + cg*6 + cb;
+}
+
+
+static void INFLASHFUN get_sgr_color(uint8_t num_params, uint16_t *params, unsigned int *i, uint8_t *color)
+{
+  // extended color following SGR 38/48 at params[*i]:
+  // "5;n" or "5:n" (256-color palette), "2;r;g;b", "2:r:g:b" or "2:cs:r:g:b" (RGB)
+  // on return, *i is the index of the last parameter used
+  unsigned int n = 0;
+  while( *i+n+1<num_params && (term->subparams & (1ul << (*i+n+1))) ) n++;
+
+  unsigned int j = *i+1;
+  if( n==0 )
+    {
+      // semicolon-separated parameters
+      if( j<num_params && params[j]==5 && j+1<num_params )
+        { if( params[j+1]<256 ) *color = params[j+1]; *i = j+1; }
+      else if( j<num_params && params[j]==2 && j+3<num_params )
+        { *color = rgb_to_color(params[j+1], params[j+2], params[j+3]); *i = j+3; }
+    }
+  else
+    {
+      // colon-separated sub-parameters (RGB optionally with a color space id)
+      if( params[j]==5 && n>=2 )
+        { if( params[j+1]<256 ) *color = params[j+1]; }
+      else if( params[j]==2 && n>=4 )
+        { j += n>=5 ? 1 : 0; *color = rgb_to_color(params[j+1], params[j+2], params[j+3]); }
+
+      *i += n;
+    }
+}
+
+
+static void INFLASHFUN terminal_process_command(char start_char, char final_char, uint8_t num_params, uint16_t *params)
 {
   // NOTE: num_params>=1 always holds, if no parameters were received then params[0]=0
   if( final_char=='l' || final_char=='h' )
@@ -341,7 +681,7 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
           switch( params[0] )
             {
             case 2:
-              if( !enabled ) { terminal_reset(); vt52_mode = true; }
+              if( !enabled ) { terminal_reset(); term->vt52_mode = true; }
               break;
 
             case 3: // switch 80/132 columm mode - 132 columns not supported but we can clear the screen
@@ -349,29 +689,45 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
               break;
 
             case 4: // enable smooth scrolling (emulated via scroll delay)
+              term->smooth_scroll = enabled && config_get_terminal_scrolldelay()>0;
               framebuf_set_scroll_delay(enabled ? config_get_terminal_scrolldelay() : 0);
               break;
               
             case 5: // invert screen
-              framebuf_set_screen_inverted(enabled);
+              set_screen_inverted(enabled);
               break;
           
             case 6: // origin mode
-              origin_mode = enabled; 
-              move_cursor_limited(scroll_region_start, 0); 
+              term->origin_mode = enabled; 
+              move_cursor_limited(term->scroll_region_start, 0); 
               break;
               
             case 7: // auto-wrap mode
-              auto_wrap_mode = enabled; 
+              term->auto_wrap_mode = enabled; 
               break;
 
             case 12: // local echo (send-receive mode)
-              localecho = !enabled;
+              term->localecho = !enabled;
               break;
               
             case 25: // show/hide cursor
-              cursor_shown = enabled;
-              show_cursor(cursor_shown);
+              term->cursor_shown = enabled;
+              show_cursor(term->cursor_shown);
+              break;
+
+            case 47:   // alternate screen
+            case 1047: // alternate screen, cleared when leaving it
+            case 1049: // save cursor and switch to cleared alternate screen
+              set_alternate_screen(enabled, params[0]);
+              break;
+
+            case 69: // left/right margin mode (DECLRMM)
+              term->lr_margin_mode = enabled;
+              if( !enabled ) reset_lr_margins();
+              break;
+
+            case 1048: // save/restore cursor
+              terminal_process_command(0, enabled ? 's' : 'u', 0, NULL);
               break;
             }
         }
@@ -380,7 +736,7 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
           switch( params[0] )
             {
             case 4: // insert mode
-              insert_mode = enabled;
+              term->insert_mode = enabled;
               break;
             }
         }
@@ -390,145 +746,135 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
       switch( params[0] )
         {
         case 0:
-          for(int i=cursor_row; i<framebuf_get_nrows(); i++) framebuf_set_row_attr(i, 0);
-          framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, framebuf_get_nrows()-1, ' ', color_fg, color_bg);
+          for(int i=term->cursor_row; i<framebuf_get_nrows(); i++) framebuf_set_row_attr(i, 0);
+          framebuf_fill_region(term->cursor_col, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, framebuf_get_nrows()-1, ' ', term->color_fg, term->color_bg);
           break;
           
         case 1:
-          for(int i=0; i<cursor_row; i++) framebuf_set_row_attr(i, 0);
-          framebuf_fill_region(0, 0, cursor_col, cursor_row, ' ', color_fg, color_bg);
+          for(int i=0; i<term->cursor_row; i++) framebuf_set_row_attr(i, 0);
+          framebuf_fill_region(0, 0, term->cursor_col, term->cursor_row, ' ', term->color_fg, term->color_bg);
           break;
           
         case 2:
           for(int i=0; i<framebuf_get_nrows(); i++) framebuf_set_row_attr(i, 0);
-          framebuf_fill_region(0, 0, framebuf_get_ncols(cursor_row)-1, framebuf_get_nrows()-1, ' ', color_fg, color_bg);
+          framebuf_fill_region(0, 0, framebuf_get_ncols(term->cursor_row)-1, framebuf_get_nrows()-1, ' ', term->color_fg, term->color_bg);
           break;
         }
 
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      show_cursor(term->cursor_shown);
     }
   else if( final_char=='K' )
     {
       switch( params[0] )
         {
         case 0:
-          framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
+          framebuf_fill_region(term->cursor_col, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, term->cursor_row, ' ', term->color_fg, term->color_bg);
           break;
           
         case 1:
-          framebuf_fill_region(0, cursor_row, cursor_col, cursor_row, ' ', color_fg, color_bg);
+          framebuf_fill_region(0, term->cursor_row, term->cursor_col, term->cursor_row, ' ', term->color_fg, term->color_bg);
           break;
           
         case 2:
-          framebuf_fill_region(0, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
+          framebuf_fill_region(0, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, term->cursor_row, ' ', term->color_fg, term->color_bg);
           break;
         }
 
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      show_cursor(term->cursor_shown);
     }
   else if( final_char=='A' )
     {
-      move_cursor_limited(cursor_row-MAX(1, params[0]), cursor_col);
+      move_cursor_limited(term->cursor_row-MAX(1, params[0]), term->cursor_col);
     }
   else if( final_char=='B' )
     {
-      move_cursor_limited(cursor_row+MAX(1, params[0]), cursor_col);
+      move_cursor_limited(term->cursor_row+MAX(1, params[0]), term->cursor_col);
     }
   else if( final_char=='C' || final_char=='a' )
     {
-      move_cursor_limited(cursor_row, cursor_col+MAX(1, params[0]));
+      move_cursor_limited(term->cursor_row, term->cursor_col+MAX(1, params[0]));
     }
   else if( final_char=='D' || final_char=='j' )
     {
-      move_cursor_limited(cursor_row, cursor_col-MAX(1, params[0]));
+      move_cursor_limited(term->cursor_row, term->cursor_col-MAX(1, params[0]));
     }
   else if( final_char=='E' || final_char=='e' )
     {
-      move_cursor_limited(cursor_row+MAX(1, params[0]), 0);
+      move_cursor_limited(term->cursor_row+MAX(1, params[0]), 0);
     }
   else if( final_char=='F' || final_char=='k' )
     {
-      move_cursor_limited(cursor_row-MAX(1, params[0]), 0);
+      move_cursor_limited(term->cursor_row-MAX(1, params[0]), 0);
     }
   else if( final_char=='d' )
     {
-      move_cursor_limited(MAX(1, params[0])-1, cursor_col);
+      move_cursor_limited(MAX(1, params[0])-1, term->cursor_col);
     }
   else if( final_char=='G' || final_char=='`' )
     {
-      move_cursor_limited(cursor_row, MAX(1, params[0])-1);
+      move_cursor_limited(term->cursor_row, MAX(1, params[0])-1);
     }
   else if( final_char=='H' || final_char=='f' )
     {
-      int top_limit    = origin_mode ? scroll_region_start : 0;
-      int bottom_limit = origin_mode ? scroll_region_end   : framebuf_get_nrows()-1;
-      move_cursor_within_region(top_limit+MAX(params[0],1)-1, num_params<2 ? 0 : MAX(params[1],1)-1, top_limit, bottom_limit);
+      int top_limit    = term->origin_mode ? term->scroll_region_start : 0;
+      int bottom_limit = term->origin_mode ? term->scroll_region_end   : framebuf_get_nrows()-1;
+      int col = num_params<2 ? 0 : MAX(params[1],1)-1;
+      if( term->origin_mode ) col = MIN(term->margin_left+col, term->margin_right);
+      move_cursor_within_region(top_limit+MAX(params[0],1)-1, col, top_limit, bottom_limit);
     }
   else if( final_char=='I' )
     {
       int n = MAX(1, params[0]);
-      int col = cursor_col+1;
-      while( n>0 && col < framebuf_get_ncols(cursor_row)-1 )
+      int right = in_lr_margins() ? term->margin_right : framebuf_get_ncols(term->cursor_row)-1;
+      int col = term->cursor_col+1;
+      while( n>0 && col < right )
         {
-          while( col < framebuf_get_ncols(cursor_row)-1 && !tabs[col] ) col++;
+          while( col < right && !term->tabs[col] ) col++;
           n--;
         }
-      move_cursor_limited(cursor_row, col); 
+      move_cursor_limited(term->cursor_row, MIN(col, right)); 
     }
   else if( final_char=='Z' )
     {
       int n = MAX(1, params[0]);
-      int col = cursor_col-1;
+      int col = term->cursor_col-1;
       while( n>0 && col>0 )
         {
-          while( col>0 && !tabs[col] ) col--;
+          while( col>0 && !term->tabs[col] ) col--;
           n--;
         }
-      move_cursor_limited(cursor_row, col); 
+      move_cursor_limited(term->cursor_row, col); 
     }
   else if( final_char=='L' || final_char=='M' )
     {
       int n = MAX(1, params[0]);
-      int bottom_limit = origin_mode ? scroll_region_end : framebuf_get_nrows()-1;
-      show_cursor(false);
-      framebuf_scroll_region(cursor_row, bottom_limit, final_char=='M' ? n : -n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      int bottom_limit = term->origin_mode ? term->scroll_region_end : framebuf_get_nrows()-1;
+      scroll_region(term->cursor_row, bottom_limit, final_char=='M' ? n : -n);
     }
   else if( final_char=='@' )
     {
       int n = MAX(1, params[0]);
-      show_cursor(false);
-      framebuf_insert(cursor_col, cursor_row, n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      framebuf_insert(term->cursor_col, right_edge(), term->cursor_row, n, term->color_fg, term->color_bg);
     }
   else if( final_char=='P' )
     {
       int n = MAX(1, params[0]);
-      framebuf_delete(cursor_col, cursor_row, n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      framebuf_delete(term->cursor_col, right_edge(), term->cursor_row, n, term->color_fg, term->color_bg);
     }
   else if( final_char=='S' || final_char=='T' )
     {
-      int top_limit    = origin_mode ? scroll_region_start : 0;
-      int bottom_limit = origin_mode ? scroll_region_end   : framebuf_get_nrows()-1;
-      int n = MAX(1, params[0]);
-      show_cursor(false);
-      while( n-- ) framebuf_scroll_region(top_limit, bottom_limit, final_char=='S' ? n : -n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      int top_limit    = term->origin_mode ? term->scroll_region_start : 0;
+      int bottom_limit = term->origin_mode ? term->scroll_region_end   : framebuf_get_nrows()-1;
+      int n = MIN(MAX(1, params[0]), bottom_limit-top_limit+1);
+      scroll_region(top_limit, bottom_limit, final_char=='S' ? n : -n);
     }
   else if( final_char=='g' )
     {
       int p = params[0];
       if( p==0 )
-        tabs[cursor_col] = false;
+        term->tabs[term->cursor_col] = false;
       else if( p==3 )
-        memset(tabs, 0, framebuf_get_ncols(-1));
+        memset(term->tabs, 0, framebuf_get_ncols(-1));
     }
   else if( final_char=='m' )
     {
@@ -539,81 +885,106 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
 
           if( p==0 )
             {
-              color_fg = config_get_terminal_default_fg();
-              color_bg = config_get_terminal_default_bg();
-              attr     = config_get_terminal_default_attr();
+              term->color_fg = config_get_terminal_default_fg();
+              term->color_bg = config_get_terminal_default_bg();
+              term->attr     = config_get_terminal_default_attr();
               //cursor_shown = true;
-              show_cursor(cursor_shown);
+              show_cursor(term->cursor_shown);
             }
           else if( p==1 )
-            attr |= ATTR_BOLD;
+            term->attr |= ATTR_BOLD;
           else if( p==4 )
-            attr |= ATTR_UNDERLINE;
+            {
+              // "4:0" is "no underline", other underline styles ("4:3") are shown as underline
+              if( i+1<num_params && (term->subparams & (1ul << (i+1))) && params[i+1]==0 )
+                term->attr &= ~ATTR_UNDERLINE;
+              else
+                term->attr |= ATTR_UNDERLINE;
+            }
           else if( p==5 )
-            attr |= ATTR_BLINK;
+            term->attr |= ATTR_BLINK;
           else if( p==7 )
-            attr |= ATTR_INVERSE;
+            term->attr |= ATTR_INVERSE;
           else if( p==22 )
-            attr &= ~ATTR_BOLD;
+            term->attr &= ~ATTR_BOLD;
           else if( p==24 )
-            attr &= ~ATTR_UNDERLINE;
+            term->attr &= ~ATTR_UNDERLINE;
           else if( p==25 )
-            attr &= ~ATTR_BLINK;
+            term->attr &= ~ATTR_BLINK;
           else if( p==27 )
-            attr &= ~ATTR_INVERSE;
+            term->attr &= ~ATTR_INVERSE;
           else if( p>=30 && p<=37 )
-            color_fg = p-30;
-          else if( p==38 && num_params>=i+2 && params[i+1]==5 )
-            { color_fg = params[i+2] & 15; i+=2; }
+            term->color_fg = p-30;
+          else if( p==38 )
+            get_sgr_color(num_params, params, &i, &term->color_fg);
           else if( p==39 )
-            color_fg = config_get_terminal_default_fg();
+            term->color_fg = config_get_terminal_default_fg();
           else if( p>=40 && p<=47 )
-            color_bg = p-40;
-          else if( p==48 && num_params>=i+2 && params[i+1]==5 )
-            { color_bg = params[i+2] & 15; i+=2; }
+            term->color_bg = p-40;
+          else if( p==48 )
+            get_sgr_color(num_params, params, &i, &term->color_bg);
           else if( p==49 )
-            color_bg = config_get_terminal_default_bg();
+            term->color_bg = config_get_terminal_default_bg();
 
-          show_cursor(cursor_shown);
+          // skip any (unsupported) sub-parameters
+          while( i+1<num_params && (term->subparams & (1ul << (i+1))) ) i++;
+
+          show_cursor(term->cursor_shown);
         }
     }
   else if( final_char=='r' )
     {
       if( num_params==2 && params[1]>params[0] )
         {
-          scroll_region_start = MAX(params[0], 1)-1;
-          scroll_region_end   = MIN(params[1], framebuf_get_nrows())-1;
+          term->scroll_region_start = MAX(params[0], 1)-1;
+          term->scroll_region_end   = MIN(params[1], framebuf_get_nrows())-1;
         }
       else if( params[0]==0 )
         {
-          scroll_region_start = 0;
-          scroll_region_end   = framebuf_get_nrows()-1;
+          term->scroll_region_start = 0;
+          term->scroll_region_end   = framebuf_get_nrows()-1;
         }
 
-      move_cursor_within_region(scroll_region_start, 0, scroll_region_start, scroll_region_end);
+      move_cursor_within_region(term->scroll_region_start, 0, term->scroll_region_start, term->scroll_region_end);
+    }
+  else if( final_char=='s' && term->lr_margin_mode && num_params>0 )
+    {
+      // set left/right margins (DECSLRM), only in left/right margin mode
+      // since otherwise CSI s saves the cursor
+      int ncols  = framebuf_get_ncols(-1);
+      int left   = MAX(params[0], 1)-1;
+      int right  = num_params<2 || params[1]==0 ? ncols-1 : MIN(params[1], ncols)-1;
+      if( right>left )
+        {
+          term->margin_left  = left;
+          term->margin_right = right;
+          move_cursor_within_region(term->origin_mode ? term->scroll_region_start : 0, 
+                                    term->origin_mode ? term->margin_left : 0, 
+                                    0, framebuf_get_nrows()-1);
+        }
     }
   else if( final_char=='s' )
     {
-      saved_row = cursor_row;
-      saved_col = cursor_col;
-      saved_eol = cursor_eol;
-      saved_origin_mode = origin_mode;
-      saved_fg  = color_fg;
-      saved_bg  = color_bg;
-      saved_attr = attr;
-      saved_charset_G0 = charset_G0;
-      saved_charset_G1 = charset_G1;
+      term->saved_row = term->cursor_row;
+      term->saved_col = term->cursor_col;
+      term->saved_eol = term->cursor_eol;
+      term->saved_origin_mode = term->origin_mode;
+      term->saved_fg  = term->color_fg;
+      term->saved_bg  = term->color_bg;
+      term->saved_attr = term->attr;
+      term->saved_charset_G0 = term->charset_G0;
+      term->saved_charset_G1 = term->charset_G1;
     }
   else if( final_char=='u' )
     {
-      move_cursor_limited(saved_row, saved_col);
-      origin_mode = saved_origin_mode;      
-      cursor_eol = saved_eol;
-      color_fg = saved_fg;
-      color_bg = saved_bg;
-      attr = saved_attr;
-      charset_G0 = saved_charset_G0;
-      charset_G1 = saved_charset_G1;
+      move_cursor_limited(term->saved_row, term->saved_col);
+      term->origin_mode = term->saved_origin_mode;      
+      term->cursor_eol = term->saved_eol;
+      term->color_fg = term->saved_fg;
+      term->color_bg = term->saved_bg;
+      term->attr = term->saved_attr;
+      term->charset_G0 = term->saved_charset_G0;
+      term->charset_G1 = term->saved_charset_G1;
     }
   else if( final_char=='c' )
     {
@@ -626,7 +997,15 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
     }
   else if( final_char=='n' )
     {
-      if( params[0] == 5 )
+      if( start_char=='?' && (params[0] == 200 || params[0] == 201) )
+        {
+          // performance counters report (see stats.h), 201 also resets them
+          char buf[160];
+          stats_format_report(buf, sizeof(buf));
+          send_string(buf);
+          if( params[0] == 201 ) stats_reset();
+        }
+      else if( params[0] == 5 )
         {
           // terminal status report
           send_string("\033[0n");
@@ -634,364 +1013,387 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
       else if( params[0] == 6 )
         {
           // cursor position report
-          int top_limit = origin_mode ? scroll_region_start : 0;
+          int top_limit = term->origin_mode ? term->scroll_region_start : 0;
           char buf[20];
-          snprintf(buf, 20, "\033[%u;%uR", cursor_row-top_limit+1, cursor_col+1);
+          snprintf(buf, 20, "\033[%u;%uR", term->cursor_row-top_limit+1, term->cursor_col+1);
           send_string(buf);
         }
     }
 }
 
 
-void INFLASHFUN terminal_receive_char_vt102(char c)
-{
-  static char    start_char = 0;
-  static uint8_t num_params = 0;
-  static uint8_t params[16];
+static const uint8_t vt102_transitions[PS_VT102_NUM][256] =
+  {
+    [PS_GROUND] = 
+    {
+      [0x00 ... 0x1A] = T(EXECUTE, GROUND), [0x1B] = T(CLEAR, ESCAPE), [0x1C ... 0xFF] = T(EXECUTE, GROUND)
+    },
 
-  if( terminal_state!=TS_NORMAL )
+    [PS_ESCAPE] = 
     {
-      if( c==8 || c==10 || c==13 )
-        {
-          // processe some cursor control characters within escape sequences
-          // (otherwise we fail "vttest" cursor control tests)
-          terminal_process_text(c);
-          return;
-        }
-      else if( c==11 )
-        {
-          // ignore VT character plus the following character
-          // (otherwise we fail "vttest" cursor control tests)
-          terminal_state = TS_READCHAR;
-          return;
-        }
-    }
+      T_C0(ESCAPE), [0x1B] = T(PRINT, GROUND),
+      [0x20 ... 0x2F] = T(COLLECT, ESC_INTERMEDIATE), 
+      [0x30 ... 0x7E] = T(ESC_DISPATCH, GROUND),
+      ['['] = T(NONE, CSI_ENTRY), [']'] = T(NONE, OSC_STRING),
+      ['P'] = T(NONE, STRING_IGNORE), ['X'] = T(NONE, STRING_IGNORE), ['^'] = T(NONE, STRING_IGNORE), ['_'] = T(NONE, STRING_IGNORE),
+      [0x7F] = T(NONE, ESCAPE), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
+
+    [PS_ESC_INTERMEDIATE] = 
+    {
+      T_C0(ESC_INTERMEDIATE),
+      [0x20 ... 0x2F] = T(COLLECT, ESC_INTERMEDIATE), 
+      [0x30 ... 0x7E] = T(ESC_DISPATCH, GROUND),
+      [0x7F] = T(NONE, ESC_INTERMEDIATE), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
+    
+    [PS_CSI_ENTRY] = 
+    {
+      T_C0(CSI_ENTRY),
+      [0x20 ... 0x2F] = T(NONE, CSI_INTERMEDIATE), 
+      [0x30 ... 0x39] = T(PARAM, CSI_PARAM), [':'] = T(NONE, CSI_IGNORE), [';'] = T(PARAM, CSI_PARAM),
+      [0x3C ... 0x3F] = T(PRIVATE, CSI_PARAM),
+      [0x40 ... 0x7E] = T(CSI_DISPATCH, GROUND),
+      [0x7F] = T(NONE, CSI_ENTRY), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
+
+    [PS_CSI_PARAM] = 
+    {
+      T_C0(CSI_PARAM),
+      [0x20 ... 0x2F] = T(NONE, CSI_INTERMEDIATE), 
+      [0x30 ... 0x39] = T(PARAM, CSI_PARAM), [':'] = T(PARAM, CSI_PARAM), [';'] = T(PARAM, CSI_PARAM),
+      [0x3C ... 0x3F] = T(NONE, CSI_IGNORE),
+      [0x40 ... 0x7E] = T(CSI_DISPATCH, GROUND),
+      [0x7F] = T(NONE, CSI_PARAM), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
+
+    [PS_CSI_INTERMEDIATE] = 
+    {
+      // no supported CSI sequence has intermediate characters => ignore them
+      T_C0(CSI_INTERMEDIATE),
+      [0x20 ... 0x2F] = T(NONE, CSI_INTERMEDIATE), 
+      [0x30 ... 0x3F] = T(NONE, CSI_IGNORE),
+      [0x40 ... 0x7E] = T(NONE, GROUND),
+      [0x7F] = T(NONE, CSI_INTERMEDIATE), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
+
+    [PS_CSI_IGNORE] = 
+    {
+      T_C0(CSI_IGNORE),
+      [0x20 ... 0x3F] = T(NONE, CSI_IGNORE), 
+      [0x40 ... 0x7E] = T(NONE, GROUND),
+      [0x7F] = T(NONE, CSI_IGNORE), [0x80 ... 0xFF] = T(NONE, GROUND)
+    },
 
-  switch( terminal_state )
+    [PS_OSC_STRING] = 
     {
-    case TS_NORMAL:
-      {
-        if( c==27 )
-          terminal_state = TS_WAITBRACKET;
-        else
-          terminal_process_text(c);
+      // operating system command, terminated by BEL or ST (ESC \)
+      [0x00 ... 0x06] = T(NONE, OSC_STRING), [0x07] = T(NONE, GROUND),
+      [0x08 ... 0x17] = T(NONE, OSC_STRING), [0x18] = T(NONE, GROUND), [0x19] = T(NONE, OSC_STRING),
+      [0x1A] = T(NONE, GROUND), [0x1B] = T(CLEAR, ESCAPE), [0x1C ... 0xFF] = T(NONE, OSC_STRING)
+    },
 
-        break;
-      }
+    [PS_STRING_IGNORE] = 
+    {
+      // DCS, SOS, PM and APC strings, terminated by ST (ESC \)
+      [0x00 ... 0x17] = T(NONE, STRING_IGNORE), [0x18] = T(NONE, GROUND), [0x19] = T(NONE, STRING_IGNORE),
+      [0x1A] = T(NONE, GROUND), [0x1B] = T(CLEAR, ESCAPE), [0x1C ... 0xFF] = T(NONE, STRING_IGNORE)
+    }
+  };
 
-    case TS_WAITBRACKET:
-      {
-        terminal_state = TS_NORMAL;
 
-        switch( c )
-          {
-          case '[':
-            start_char = 0;
-            num_params = 1;
-            params[0] = 0;
-            terminal_state = TS_STARTCHAR;
-            break;
-            
-          case '#':
-            terminal_state = TS_HASH;
-            break;
-            
-          case  27: print_char_vt(c); break;                           // escaped ESC
-          case 'c': terminal_reset(); break;                           // reset
-          case '7': terminal_process_command(0, 's', 0, NULL); break;  // save cursor position
-          case '8': terminal_process_command(0, 'u', 0, NULL); break;  // restore cursor position
-          case 'H': tabs[cursor_col] = true; break;                    // set tab
-          case 'J': terminal_process_command(0, 'J', 0, NULL); break;  // clear to end of screen
-          case 'K': terminal_process_command(0, 'K', 0, NULL); break;  // clear to end of row
-          case 'D': move_cursor_wrap(cursor_row+1, cursor_col); break; // cursor down
-          case 'E': move_cursor_wrap(cursor_row+1, 0); break;          // cursor down and to first column
-          case 'I': move_cursor_wrap(cursor_row-1, 0); break;          // cursor up and to furst column
-          case 'M': move_cursor_wrap(cursor_row-1, cursor_col); break; // cursor up
-          case '(': 
-          case ')': 
-          case '+':
-          case '*':
-            start_char = c;
-            terminal_state = TS_READCHAR;
-            break;
-          }
+static const uint8_t vt52_transitions[PS_VT52_NUM][256] =
+  {
+    [PS_GROUND] = 
+    {
+      [0x00 ... 0x1A] = T(EXECUTE, GROUND), [0x1B] = T(CLEAR, ESCAPE), [0x1C ... 0xFF] = T(EXECUTE, GROUND)
+    },
 
-        break;
-      }
+    [PS_ESCAPE] = 
+    {
+      T_C0(ESCAPE),
+      [0x20 ... 0xFF] = T(ESC_DISPATCH, GROUND),
+      ['Y'] = T(NONE, VT52_ROW), ['b'] = T(NONE, VT52_FG), ['c'] = T(NONE, VT52_BG)
+    },
 
-    case TS_STARTCHAR:
-    case TS_READPARAM:
-      {
-        if( c>='0' && c<='9' )
+    [PS_VT52_ROW] = { T_C0(VT52_ROW), [0x20 ... 0xFF] = T(VT52_ROW, VT52_COL) },
+    [PS_VT52_COL] = { T_C0(VT52_COL), [0x20 ... 0xFF] = T(VT52_COL, GROUND)   },
+    [PS_VT52_FG]  = { T_C0(VT52_FG),  [0x20 ... 0xFF] = T(VT52_FG,  GROUND)   },
+    [PS_VT52_BG]  = { T_C0(VT52_BG),  [0x20 ... 0xFF] = T(VT52_BG,  GROUND)   }
+  };
+
+
+static void INFLASHFUN terminal_process_esc(uint8_t intermediate, char final_char)
+{
+  if( intermediate==0 )
+    {
+      switch( final_char )
+        {
+        case 'c': set_page(term->page & ~1); terminal_reset(); break; // reset
+        case '7': terminal_process_command(0, 's', 0, NULL); break;  // save cursor position
+        case '8': terminal_process_command(0, 'u', 0, NULL); break;  // restore cursor position
+        case 'H': term->tabs[term->cursor_col] = true; break;                    // set tab
+        case 'J': terminal_process_command(0, 'J', 0, NULL); break;  // clear to end of screen
+        case 'K': terminal_process_command(0, 'K', 0, NULL); break;  // clear to end of row
+        case 'D': move_cursor_wrap(term->cursor_row+1, term->cursor_col); break; // cursor down
+        case 'E': move_cursor_wrap(term->cursor_row+1, 0); break;          // cursor down and to first column
+        case 'I': move_cursor_wrap(term->cursor_row-1, 0); break;          // cursor up and to furst column
+        case 'M': move_cursor_wrap(term->cursor_row-1, term->cursor_col); break; // cursor up
+        }
+    }
+  else if( intermediate=='#' )
+    {
+      switch( final_char )
+        {
+        case '3':
           {
-            params[num_params-1] = params[num_params-1]*10 + (c-'0');
-            terminal_state = TS_READPARAM;
+            framebuf_set_row_attr(term->cursor_row, ROW_ATTR_DBL_WIDTH | ROW_ATTR_DBL_HEIGHT_TOP);
+            break;
           }
-        else if( c == ';' )
+          
+        case '4':
           {
-            // next parameter (max 16 parameters)
-            num_params++;
-            if( num_params>16 )
-              terminal_state = TS_NORMAL;
-            else
-              {
-                params[num_params-1]=0;
-                terminal_state = TS_READPARAM;
-              }
+            framebuf_set_row_attr(term->cursor_row, ROW_ATTR_DBL_WIDTH | ROW_ATTR_DBL_HEIGHT_BOT);
+            break;
           }
-        else if( terminal_state==TS_STARTCHAR && (c=='?' || c=='#') )
+          
+        case '5':
           {
-            start_char = c;
-            terminal_state = TS_READPARAM;
+            framebuf_set_row_attr(term->cursor_row, 0);
+            break;
           }
-        else
+          
+        case '6':
           {
-            // not a parameter value or startchar => command is done
-            terminal_process_command(start_char, c, num_params, params);
-            terminal_state = TS_NORMAL;
+            framebuf_set_row_attr(term->cursor_row, ROW_ATTR_DBL_WIDTH);
+            break;
           }
-        
-        break;
-      }
-
-    case TS_HASH:
-      {
-        switch( c )
+          
+        case '8': 
           {
-          case '3':
-            {
-              framebuf_set_row_attr(cursor_row, ROW_ATTR_DBL_WIDTH | ROW_ATTR_DBL_HEIGHT_TOP);
-              break;
-            }
-
-          case '4':
-            {
-              framebuf_set_row_attr(cursor_row, ROW_ATTR_DBL_WIDTH | ROW_ATTR_DBL_HEIGHT_BOT);
-              break;
-            }
-            
-          case '5':
-            {
-              framebuf_set_row_attr(cursor_row, 0);
-              break;
-            }
-
-          case '6':
-            {
-              framebuf_set_row_attr(cursor_row, ROW_ATTR_DBL_WIDTH);
-              break;
-            }
-
-          case '8': 
-            {
-              // fill screen with 'E' characters (DEC test feature)
-              int top_limit    = origin_mode ? scroll_region_start : 0;
-              int bottom_limit = origin_mode ? scroll_region_end   : framebuf_get_nrows()-1;
-              show_cursor(false);
-              framebuf_fill_region(0, top_limit, framebuf_get_ncols(-1)-1, bottom_limit, 'E', color_fg, color_bg);
-              cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-              show_cursor(cursor_shown);
-              break;
-            }
+            // fill screen with 'E' characters (DEC test feature)
+            int top_limit    = term->origin_mode ? term->scroll_region_start : 0;
+            int bottom_limit = term->origin_mode ? term->scroll_region_end   : framebuf_get_nrows()-1;
+            framebuf_fill_region(0, top_limit, framebuf_get_ncols(-1)-1, bottom_limit, 'E', term->color_fg, term->color_bg);
+            break;
           }
-        
-        terminal_state = TS_NORMAL;
-        break;
-      }
-
-    case TS_READCHAR:
-      {
-        if( start_char=='(' )
-          charset_G0 = get_charset(c);
-        else if( start_char==')' )
-          charset_G1 = get_charset(c);
-
-        terminal_state = TS_NORMAL;
-        break;
-      }
+        }
     }
+  else if( intermediate=='(' )
+    term->charset_G0 = get_charset(final_char);
+  else if( intermediate==')' )
+    term->charset_G1 = get_charset(final_char);
 }
 
 
-void INFLASHFUN terminal_receive_char_vt52(char c)
+static void INFLASHFUN terminal_receive_char_vt102(uint8_t c)
 {
-  static char start_char, row;
+  // the state is updated before the action is performed so that any
+  // terminal input generated by the action (local echo) starts out
+  // in the correct state
+  uint8_t t = vt102_transitions[term->terminal_state][c];
+  term->terminal_state = t & 0x0F;
 
-  switch( terminal_state )
+  switch( t >> 4 )
     {
-    case TS_NORMAL:
-      {
-        if( c==27 )
-          terminal_state = TS_STARTCHAR;
-        else
-          terminal_process_text(c);
-        
-        break;
-      }
-
-    case TS_STARTCHAR:
-      {
-        terminal_state = TS_NORMAL;
-
-        switch( c )
-          {
-          case 'A': 
-            move_cursor_limited(cursor_row-1, cursor_col);
-            break;
-
-          case 'B': 
-            move_cursor_limited(cursor_row+1, cursor_col);
-            break;
-
-          case 'C': 
-            move_cursor_limited(cursor_row, cursor_col+1);
-            break;
-
-          case 'D': 
-            move_cursor_limited(cursor_row, cursor_col-1);
-            break;
-
-          case 'E':
-            framebuf_fill_screen(' ', color_fg, color_bg);
-            // fall through
-
-          case 'H': 
-            move_cursor_limited(0, 0);
-            break;
-
-          case 'I': 
-            move_cursor_wrap(cursor_row-1, cursor_col);
-            break;
-
-          case 'J':
-            show_cursor(false);
-            framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, framebuf_get_nrows()-1, ' ', color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
-            break;
-
-          case 'K':
-            show_cursor(false);
-            framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
-            break;
+    case PA_EXECUTE:
+      terminal_process_text(c);
+      break;
 
-          case 'L':
-          case 'M':
-            show_cursor(false);
-            framebuf_scroll_region(cursor_row, framebuf_get_nrows()-1, c=='M' ? 1 : -1, color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
-            break;
+    case PA_PRINT:
+      PROFILE(PROF_PRINT_CHAR, print_char_vt(c));
+      break;
 
-          case 'Y':
-            start_char = c;
-            row = 0;
-            terminal_state = TS_READPARAM;
-            break;
-            
-          case 'Z':
-            send_string("\033/K");
-            break;
+    case PA_CLEAR:
+      term->intermediate = 0;
+      term->start_char = 0;
+      term->num_params = 1;
+      term->params[0] = 0;
+      term->subparams = 0;
+      break;
 
-          case 'b':
-          case 'c':
-            start_char = c;
-            terminal_state = TS_READPARAM;
-            break;
+    case PA_COLLECT:
+      // only one intermediate character is supported
+      term->intermediate = term->intermediate==0 ? c : 0xFF;
+      break;
 
-          case 'd':
-            framebuf_fill_region(0, 0, cursor_col, cursor_row, ' ', color_fg, color_bg);
-            init_cursor(cursor_col, cursor_row);
-            break;
-            
-          case 'e':
-            show_cursor(true);
-            break;
+    case PA_PRIVATE:
+      term->start_char = c;
+      break;
 
-          case 'f':
-            show_cursor(false);
-            break;
+    case PA_PARAM:
+      if( c==';' || c==':' )
+        {
+          // next parameter (max 16 parameters, any further ones are 
+          // collected in params[16] and ignored), ':' separates
+          // sub-parameters (e.g. "38:2::r:g:b")
+          if( term->num_params<17 ) term->num_params++;
+          term->params[term->num_params-1] = 0;
+          if( c==':' ) term->subparams |= 1ul << (term->num_params-1);
+        }
+      else
+        {
+          // parameter values are limited to 9999
+          uint32_t v = term->params[term->num_params-1]*10 + (c-'0');
+          term->params[term->num_params-1] = MIN(v, 9999);
+        }
+      break;
 
-          case 'j':
-            saved_col = cursor_col;
-            saved_row = cursor_row;
-            break;
+    case PA_ESC_DISPATCH:
+      terminal_process_esc(term->intermediate, c);
+      break;
 
-          case 'k':
-            move_cursor_limited(saved_row, saved_col);
-            break;
+    case PA_CSI_DISPATCH:
+      if( term->start_char==0 || term->start_char=='?' )
+        terminal_process_command(term->start_char, c, MIN(term->num_params, 16), term->params);
+      break;
+    }
+}
 
-          case 'l':
-            framebuf_fill_region(0, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
-            init_cursor(0, cursor_row);
-            break;
 
-          case 'o':
-            framebuf_fill_region(0, cursor_row, cursor_col, cursor_row, ' ', color_fg, color_bg);
-            show_cursor(cursor_shown);
-            break;
+static void INFLASHFUN terminal_process_esc_vt52(char c)
+{
+  switch( c )
+    {
+    case 'A': 
+      move_cursor_limited(term->cursor_row-1, term->cursor_col);
+      break;
+      
+    case 'B': 
+      move_cursor_limited(term->cursor_row+1, term->cursor_col);
+      break;
+      
+    case 'C': 
+      move_cursor_limited(term->cursor_row, term->cursor_col+1);
+      break;
+      
+    case 'D': 
+      move_cursor_limited(term->cursor_row, term->cursor_col-1);
+      break;
+      
+    case 'E':
+      framebuf_fill_screen(' ', term->color_fg, term->color_bg);
+      // fall through
+      
+    case 'H': 
+      move_cursor_limited(0, 0);
+      break;
+      
+    case 'I': 
+      move_cursor_wrap(term->cursor_row-1, term->cursor_col);
+      break;
+      
+    case 'J':
+      framebuf_fill_region(term->cursor_col, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, framebuf_get_nrows()-1, ' ', term->color_fg, term->color_bg);
+      break;
+      
+    case 'K':
+      framebuf_fill_region(term->cursor_col, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, term->cursor_row, ' ', term->color_fg, term->color_bg);
+      break;
+      
+    case 'L':
+    case 'M':
+      framebuf_scroll_region(term->cursor_row, framebuf_get_nrows()-1, c=='M' ? 1 : -1, term->color_fg, term->color_bg);
+      break;
+      
+    case 'Z':
+      send_string("\033/K");
+      break;
+      
+    case 'd':
+      framebuf_fill_region(0, 0, term->cursor_col, term->cursor_row, ' ', term->color_fg, term->color_bg);
+      init_cursor(term->cursor_col, term->cursor_row);
+      break;
+      
+    case 'e':
+      show_cursor(true);
+      break;
+      
+    case 'f':
+      show_cursor(false);
+      break;
+      
+    case 'j':
+      term->saved_col = term->cursor_col;
+      term->saved_row = term->cursor_row;
+      break;
+      
+    case 'k':
+      move_cursor_limited(term->saved_row, term->saved_col);
+      break;
+      
+    case 'l':
+      framebuf_fill_region(0, term->cursor_row, framebuf_get_ncols(term->cursor_row)-1, term->cursor_row, ' ', term->color_fg, term->color_bg);
+      init_cursor(0, term->cursor_row);
+      break;
+      
+    case 'o':
+      framebuf_fill_region(0, term->cursor_row, term->cursor_col, term->cursor_row, ' ', term->color_fg, term->color_bg);
+      show_cursor(term->cursor_shown);
+      break;
+      
+    case 'p':
+      set_screen_inverted(true);
+      break;
+      
+    case 'q':
+      set_screen_inverted(false);
+      break;
+      
+    case 'v':
+      term->auto_wrap_mode = true;
+      break;
+      
+    case 'w':
+      term->auto_wrap_mode = false;
+      break;
+      
+    case '<':
+      terminal_reset();
+      term->vt52_mode = false;
+      break;
+    }
+}
 
-          case 'p':
-            framebuf_set_screen_inverted(true);
-            break;
 
-          case 'q':
-            framebuf_set_screen_inverted(false);
-            break;
+static void INFLASHFUN terminal_receive_char_vt52(uint8_t c)
+{
+  uint8_t t = vt52_transitions[term->terminal_state][c];
+  term->terminal_state = t & 0x0F;
 
-          case 'v':
-            auto_wrap_mode = true;
-            break;
+  switch( t >> 4 )
+    {
+    case PA_EXECUTE:
+      terminal_process_text(c);
+      break;
 
-          case 'w':
-            auto_wrap_mode = false;
-            break;
+    case PA_ESC_DISPATCH:
+      terminal_process_esc_vt52(c);
+      break;
 
-          case '<':
-            terminal_reset();
-            vt52_mode = false;
-            break;
-          }
+    case PA_VT52_ROW:
+      term->vt52_row = c;
+      break;
 
-        break;
-      }
+    case PA_VT52_COL:
+      move_cursor_limited(term->vt52_row-32, c-32);
+      break;
 
-    case TS_READPARAM:
-      {
-        if( start_char=='Y' )
-          {
-            if( row==0 )
-              row = c;
-            else
-              {
-                if( row>=32 && c>=32 ) move_cursor_limited(row-32, c-32);
-                terminal_state = TS_NORMAL;
-              }
-          }
-        else if( start_char=='b' && c>=32 )
-          {
-            color_fg = (c-32) & 15;
-            show_cursor(cursor_shown);
-          }
-        else if( start_char=='c' && c>=32 )
-          {
-            color_bg = (c-32) & 15;
-            show_cursor(cursor_shown);
-          }
+    case PA_VT52_FG:
+      term->color_fg = (c-32) & 15;
+      show_cursor(term->cursor_shown);
+      break;
 
-        break;
-      }
+    case PA_VT52_BG:
+      term->color_bg = (c-32) & 15;
+      show_cursor(term->cursor_shown);
+      break;
     }
 }
 
 
 static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
 {
-  static uint8_t inserted = 0;
-  static bool quoteMode = false;
-
   if( c>=192 )
     {
       if     ( c<=223 ) c -= 96;
@@ -999,12 +1401,12 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       else if( c==255 ) c  = 126;
     }
 
-  if( c==34 ) quoteMode=!quoteMode;
+  if( c==34 ) term->petscii_quote_mode=!term->petscii_quote_mode;
 
-  if( (quoteMode || inserted>0) )
+  if( (term->petscii_quote_mode || term->petscii_inserted>0) )
     {
       uint8_t cc = 0;
-      if( c<32 && c!=13 && (!quoteMode || c!=20) )
+      if( c<32 && c!=13 && (!term->petscii_quote_mode || c!=20) )
         {
           switch( c )
             {
@@ -1013,29 +1415,29 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
             case 29: cc = 0x5D; break;
             case 30: cc = 0x98; break;
             case 31: cc = 0x99; break;
-            default: cc = petscii_lower_case_charset ? c+96 : c+64; break;
+            default: cc = term->petscii_lower_case_charset ? c+96 : c+64; break;
             }
         }
-      else if( c>=128 && c<160 && (quoteMode || c!=148) )
+      else if( c>=128 && c<160 && (term->petscii_quote_mode || c!=148) )
         {
           switch( c )
             {
             case 155: cc = 0x9B; break;
             case 156: cc = 0x9C; break;
             case 157: cc = 0x9D; break;
-            case 158: cc = petscii_lower_case_charset ? 0x9E : 0xCE; break;
-            case 159: cc = petscii_lower_case_charset ? 0x9F : 0xDF; break;
-            default:  cc = petscii_lower_case_charset ? c-64 : c+64; break;
+            case 158: cc = term->petscii_lower_case_charset ? 0x9E : 0xCE; break;
+            case 159: cc = term->petscii_lower_case_charset ? 0x9F : 0xDF; break;
+            default:  cc = term->petscii_lower_case_charset ? c-64 : c+64; break;
             }
         }
           
       if( cc>0 )
         {
-          uint8_t a = attr;
-          attr |= ATTR_INVERSE;
+          uint8_t a = term->attr;
+          term->attr |= ATTR_INVERSE;
           print_char_petscii(cc);
-          if( inserted>0 ) inserted--;
-          attr = a;
+          if( term->petscii_inserted>0 ) term->petscii_inserted--;
+          term->attr = a;
           return;
         }
     }
@@ -1043,7 +1445,7 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
   switch( c )
     {
     case 5: // WHITE
-      color_fg = 1;
+      term->color_fg = 1;
       break;
 
     case 10:  // LF
@@ -1052,16 +1454,16 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       {
         switch( c==10 ? config_get_terminal_lf() : config_get_terminal_cr() )
           {
-          case 1: move_cursor_wrap(cursor_row, 0); break;
-          case 2: move_cursor_wrap(cursor_row+1, cursor_col); break;
-          case 3: move_cursor_wrap(cursor_row+1, 0); break;
+          case 1: move_cursor_wrap(term->cursor_row, 0); break;
+          case 2: move_cursor_wrap(term->cursor_row+1, term->cursor_col); break;
+          case 3: move_cursor_wrap(term->cursor_row+1, 0); break;
           }
-        if( c!=10 ) { inserted = 0; quoteMode = false; attr &= ~ATTR_INVERSE; }
+        if( c!=10 ) { term->petscii_inserted = 0; term->petscii_quote_mode = false; term->attr &= ~ATTR_INVERSE; }
         break;
       }
 
     case 14: // Switch to lower case character set
-      petscii_lower_case_charset = true;
+      term->petscii_lower_case_charset = true;
       for(uint8_t row=0; row<framebuf_get_nrows(); row++)
         for(uint8_t col=0; col<framebuf_get_ncols(col); col++)
           {
@@ -1077,11 +1479,11 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       break;
 
     case 17: // cursor down
-      move_cursor_wrap(cursor_row+1, cursor_col);
+      move_cursor_wrap(term->cursor_row+1, term->cursor_col);
       break;
 
     case 18: // enable reverse character mode
-      attr |= ATTR_INVERSE;
+      term->attr |= ATTR_INVERSE;
       break;
 
     case 19: // cursor home
@@ -1089,37 +1491,36 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       break;
 
     case 20: // backspace/delete
-      if( cursor_col>0 || cursor_row>0 )
+      if( term->cursor_col>0 || term->cursor_row>0 )
         {
-          move_cursor_wrap(cursor_row, cursor_col-1);
-          framebuf_delete(cursor_col, cursor_row, 1, color_fg, color_bg);
-          cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-          show_cursor(cursor_shown);
+          move_cursor_wrap(term->cursor_row, term->cursor_col-1);
+          framebuf_delete(term->cursor_col, framebuf_get_ncols(-1)-1, term->cursor_row, 1, term->color_fg, term->color_bg);
+          show_cursor(term->cursor_shown);
         }
       break;
 
     case 28: // red
-      color_fg = 2;
+      term->color_fg = 2;
       break;
 
     case 29: // cursor right
-      move_cursor_wrap(cursor_row, cursor_col+1);
+      move_cursor_wrap(term->cursor_row, term->cursor_col+1);
       break;
       
     case 30: // green
-      color_fg = 5;
+      term->color_fg = 5;
       break;
 
     case 31: // blue
-      color_fg = 6;
+      term->color_fg = 6;
       break;
 
     case 129: // orange
-      color_fg = 8;
+      term->color_fg = 8;
       break;
 
     case 142: // Switch to upper case character set
-      petscii_lower_case_charset = false;
+      term->petscii_lower_case_charset = false;
       for(uint8_t row=0; row<framebuf_get_nrows(); row++)
         for(uint8_t col=0; col<framebuf_get_ncols(col); col++)
           {
@@ -1135,15 +1536,15 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       break;
 
     case 144: // black
-      color_fg = 0;
+      term->color_fg = 0;
       break;
 
     case 145: // cursor up
-      move_cursor_limited(cursor_row-1, cursor_col);
+      move_cursor_limited(term->cursor_row-1, term->cursor_col);
       break;
 
     case 146: // disable reverse character mode
-      attr &= ~ATTR_INVERSE;
+      term->attr &= ~ATTR_INVERSE;
       break;
 
     case 147: // clear screen
@@ -1151,66 +1552,63 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       break;
 
     case 148: // insert
-      show_cursor(false);
-      framebuf_insert(cursor_col, cursor_row, 1, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
-      inserted++;
+      framebuf_insert(term->cursor_col, framebuf_get_ncols(-1)-1, term->cursor_row, 1, term->color_fg, term->color_bg);
+      term->petscii_inserted++;
       break;
 
     case 149: // brown
-      color_fg = 9;
+      term->color_fg = 9;
       break;
 
     case 150: // light red
-      color_fg = 10;
+      term->color_fg = 10;
       break;
 
     case 151: // dark grey
-      color_fg = 11;
+      term->color_fg = 11;
       break;
 
     case 152: // grey
-      color_fg = 12;
+      term->color_fg = 12;
       break;
 
     case 153: // light green
-      color_fg = 13;
+      term->color_fg = 13;
       break;
 
     case 154: // light blue
-      color_fg = 14;
+      term->color_fg = 14;
       break;
 
     case 155: // light gray
-      color_fg = 15;
+      term->color_fg = 15;
       break;
 
     case 156: // purple
-      color_fg = 4;
+      term->color_fg = 4;
       break;
 
     case 157: // cursor left
-      if( cursor_row>0 )
-        move_cursor_wrap(cursor_row, cursor_col-1);
+      if( term->cursor_row>0 )
+        move_cursor_wrap(term->cursor_row, term->cursor_col-1);
       else
-        move_cursor_limited(cursor_row, cursor_col-1);
+        move_cursor_limited(term->cursor_row, term->cursor_col-1);
       break;
 
     case 158: // yellow
-      color_fg = 7;
+      term->color_fg = 7;
       break;
 
     case 159: // cyan
-      color_fg = 3;
+      term->color_fg = 3;
       break;
 
     default:
       {
-        if( c>=65 && c<=90 && petscii_lower_case_charset )
+        if( c>=65 && c<=90 && term->petscii_lower_case_charset )
           c += 32;
         else if( c>=97 && c<=122 )
-          c  = petscii_lower_case_charset ? c-32 : c+96;
+          c  = term->petscii_lower_case_charset ? c-32 : c+96;
         else if( c>=149 && c<=191 && c!=169 && c!=186 )
           c += 64; // more PETSCII graphics characters
         else if( c>=133 && c<=140 )
@@ -1226,51 +1624,131 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
               case 123: c = 0x9B; break; // cross
               case 124: c = 0x9C; break; // left checkerboard
               case 125: c = 0x9D; break; // middle vertical line
-              case 126: c = petscii_lower_case_charset ? 0x9E : 0xDE ; break; // full checkerboard / pi
-              case 127: c = petscii_lower_case_charset ? 0x9F : 0xDF ; break; // down diagonals / top right triangle
-              case 169: c = petscii_lower_case_charset ? 0xA9 : 0xE9 ; break; // up diagonals / top left triangle
-              case 186: c = petscii_lower_case_charset ? 0xBA : 0xFA ; break; // checkmark / bottom right corner
+              case 126: c = term->petscii_lower_case_charset ? 0x9E : 0xDE ; break; // full checkerboard / pi
+              case 127: c = term->petscii_lower_case_charset ? 0x9F : 0xDF ; break; // down diagonals / top right triangle
+              case 169: c = term->petscii_lower_case_charset ? 0xA9 : 0xE9 ; break; // up diagonals / top left triangle
+              case 186: c = term->petscii_lower_case_charset ? 0xBA : 0xFA ; break; // checkmark / bottom right corner
               }
           }
 
         if( c>0 ) print_char_petscii(c);
-        if( inserted>0 ) inserted--;
+        if( term->petscii_inserted>0 ) term->petscii_inserted--;
         break;
       }
     }
 }
 
 
-void INFLASHFUN terminal_receive_char(char c)
+static void INFLASHFUN terminal_receive_char_vt102_or_vt52(uint8_t c)
+{
+  // VT102 terminal type, switched to VT52 mode by the host
+  if( !term->vt52_mode )
+    terminal_receive_char_vt102(c);
+  else
+    terminal_receive_char_vt52(c);
+}
+
+
+static void INFLASHFUN compile_policy()
 {
-  if( config_get_terminal_clearBit7() ) c &= 0x7f;
+  policy.rx_mask    = config_get_terminal_clearBit7() ? 0x7f : 0xff;
+  policy.print_runs = config_get_terminal_type()!=CFG_TTYPE_PETSCII;
 
   switch( config_get_terminal_type() )
     {
-    case CFG_TTYPE_VT102:
-      if( !vt52_mode ) { terminal_receive_char_vt102(c); break; }
+    case CFG_TTYPE_VT52:    policy.receive_char = terminal_receive_char_vt52; break;
+    case CFG_TTYPE_PETSCII: policy.receive_char = terminal_receive_char_petscii; break;
+    default:                policy.receive_char = terminal_receive_char_vt102_or_vt52; break;
+    }
+}
 
-    case CFG_TTYPE_VT52:
-      terminal_receive_char_vt52(c);
-      break;
 
-    case CFG_TTYPE_PETSCII:
-      terminal_receive_char_petscii(c);
-      break;
+void INFLASHFUN terminal_receive_buffer(const uint8_t *buf, size_t len)
+{
+  // input may be received recursively (local echo of a response)
+  const uint8_t *prev_lookahead = lookahead;
+  size_t prev_lookahead_len = lookahead_len;
+  uint32_t start_time = time_us_32();
+  stats.parser_bytes += len;
+  PROFILE_BEGIN(profile_start);
+
+  while( len>0 )
+    {
+      size_t n = 0;
+
+      // runs of printable characters bypass the parser
+      if( policy.print_runs )
+        PROFILE(PROF_PRINT_RUN, n = print_run_vt(buf, len));
+
+      if( n==0 )
+        {
+          lookahead = buf+1;
+          lookahead_len = len-1;
+          policy.receive_char(*buf & policy.rx_mask);
+          n = 1;
+        }
+
+      buf += n;
+      len -= n;
+    }
+
+  lookahead = prev_lookahead;
+  lookahead_len = prev_lookahead_len;
+
+  PROFILE_END(PROF_TERMINAL_RECEIVE, profile_start);
+
+  // (time spent on recursively received input is already included here)
+  if( prev_lookahead==NULL ) stats.parser_us += time_us_32()-start_time;
+}
+
+
+void INFLASHFUN terminal_console_receive_buffer(uint8_t console, const uint8_t *buf, size_t len)
+{
+  // input for a console that is not visible goes to its own frame buffer
+  // page, the visible one is not touched
+  if( console!=visible_console ) select_console(console);
+  terminal_receive_buffer(buf, len);
+  if( console!=visible_console ) select_console(visible_console);
+}
+
+
+void INFLASHFUN terminal_show_console(uint8_t console)
+{
+  // switching consoles only switches the frame buffer page that is
+  // shown, nothing needs to be redrawn
+  if( console<TERMINAL_NUM_CONSOLES && console!=visible_console )
+    {
+      visible_console = console;
+      select_console(console);
+      framebuf_show_page(term->page);
+      framebuf_set_screen_inverted(term->screen_inverted);
+      show_cursor(term->cursor_shown);
     }
 }
 
 
+uint8_t INFLASHFUN terminal_get_visible_console()
+{
+  return visible_console;
+}
+
+
+void INFLASHFUN terminal_receive_char(char c)
+{
+  uint8_t b = c;
+  terminal_receive_buffer(&b, 1);
+}
+
 
 void INFLASHFUN terminal_receive_string(const char* str)
 {
-  while( *str ) { terminal_receive_char(*str); str++; }
+  terminal_receive_buffer((const uint8_t *) str, strlen(str));
 }
 
 
 static void INFLASHFUN send_cursor_sequence(char c)
 {
-  if( config_get_terminal_type()==CFG_TTYPE_VT52 || vt52_mode )
+  if( config_get_terminal_type()==CFG_TTYPE_VT52 || term->vt52_mode )
     { send_char(27); send_char(c); }
   else
     { send_char(27); send_char('['); send_char(c); }
@@ -1302,7 +1780,7 @@ static void INFLASHFUN terminal_process_key_vt(uint16_t key)
     case KEY_F4:
       {
         send_char(27);
-        if( config_get_terminal_type()==CFG_TTYPE_VT102 && !vt52_mode ) send_char('O');
+        if( config_get_terminal_type()==CFG_TTYPE_VT102 && !term->vt52_mode ) send_char('O');
         send_char('P' + (c-KEY_F1));
         break;
       }
@@ -1415,7 +1893,7 @@ static void INFLASHFUN terminal_process_key_petscii(uint16_t key)
             cc = colors[c-'1'];
           }
         else if( keyboard_ctrl_pressed(key) && keyboard_shift_pressed(key) && (key&0xFF)==HID_KEY_Z )
-          cc = petscii_lower_case_charset ? 142 : 14;
+          cc = term->petscii_lower_case_charset ? 142 : 14;
         else if( c>='a' && c<='z' )
           cc = c - 32;
         else if( c>='A' && c<='Z' )
@@ -1450,7 +1928,7 @@ void INFLASHFUN terminal_process_key(uint16_t key)
   else if( key==HID_KEY_F10 )
     {
       sound_play_tone(880, 50, config_get_audible_bell_volume(), false);
-      localecho = !localecho;
+      term->localecho = !term->localecho;
     }
   else if( config_get_terminal_type()==2 )
     terminal_process_key_petscii(key);
@@ -1461,8 +1939,20 @@ void INFLASHFUN terminal_process_key(uint16_t key)
 
 void INFLASHFUN terminal_init()
 {
-  terminal_reset();
-  terminal_clear_screen();
+  compile_policy();
+
+  // reset all consoles and show the first one
+  visible_console = 0;
+  framebuf_show_page(0);
+  framebuf_set_screen_inverted(false);
+  for(int i=TERMINAL_NUM_CONSOLES-1; i>=0; i--)
+    {
+      consoles[i].page = i*2;
+      consoles[i].screen_inverted = false;
+      select_console(i);
+      terminal_reset();
+      terminal_clear_screen();
+    }
 }
 
 
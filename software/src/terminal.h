@@ -22,8 +22,19 @@
 
 void terminal_receive_char(char c);
 void terminal_receive_string(const char* str);
+void terminal_receive_buffer(const uint8_t *buf, size_t len);
+void terminal_console_receive_buffer(uint8_t console, const uint8_t *buf, size_t len);
 void terminal_process_key(uint16_t key);
 
+// consoles (separate terminal sessions with their own screen), the USB
+// console is only used if the USB CDC device mode is "separate console"
+#define TERMINAL_CONSOLE_MAIN 0
+#define TERMINAL_CONSOLE_USB  1
+#define TERMINAL_NUM_CONSOLES 2
+
+void    terminal_show_console(uint8_t console);
+uint8_t terminal_get_visible_console();
+
 void terminal_clear_screen();
 void terminal_init();
 void terminal_apply_settings();